@@ -0,0 +1,106 @@
+// Checks that adding jobs to a ThreadPool does not allocate once it has warmed
+// up. Built as its own executable rather than as part of the game, as it
+// replaces the global allocator to count every allocation
+// See docs/benchmarks.md
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+#include <fmt/base.h>
+
+#include "threadpool.hpp"
+
+namespace {
+// Heap allocations made by any thread while sCountAllocations is set
+std::atomic<bool> sCountAllocations = false;
+std::atomic<size_t> sAllocations = 0;
+
+void* countedAlloc(size_t size, size_t alignment) {
+  if (sCountAllocations.load(std::memory_order_relaxed))
+    sAllocations.fetch_add(1, std::memory_order_relaxed);
+  size = std::max<size_t>(size, 1);
+  void* ptr = alignment <= alignof(std::max_align_t)
+                  ? std::malloc(size)
+                  // aligned_alloc requires a multiple of the alignment
+                  : std::aligned_alloc(alignment, (size + alignment - 1) /
+                                                      alignment * alignment);
+  if (ptr == nullptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+// A little work that the compiler can't optimise away
+uint64_t busyWork(uint64_t seed) {
+  for (int i = 0; i < 16; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+  }
+  return seed;
+}
+} // namespace
+
+// The array and nothrow forms forward to these
+void* operator new(size_t size) {
+  return countedAlloc(size, alignof(std::max_align_t));
+}
+void* operator new(size_t size, std::align_val_t alignment) {
+  return countedAlloc(size, static_cast<size_t>(alignment));
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+int main() {
+  const static constexpr int JobCount = 100000;
+  const static constexpr int WarmupFrames = 3;
+  const static constexpr int Frames = 30;
+
+  unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+  selwonk::ThreadPool pool(threads - 1);
+  pool.reserve(JobCount);
+  std::atomic<uint64_t> sink = 0;
+
+  auto frame = [&] {
+    for (int i = 0; i < JobCount; i++) {
+      pool.addJob([&sink, i] {
+        sink.fetch_add(busyWork(i), std::memory_order_relaxed);
+      });
+    }
+    pool.awaitAll();
+  };
+
+  for (int f = 0; f < WarmupFrames; f++) {
+    frame();
+  }
+
+  size_t total = 0;
+  size_t worst = 0;
+  for (int f = 0; f < Frames; f++) {
+    sAllocations = 0;
+    sCountAllocations = true;
+    frame();
+    sCountAllocations = false;
+    total += sAllocations;
+    worst = std::max<size_t>(worst, sAllocations);
+  }
+
+  fmt::println("Job allocations, {} jobs per frame on {} threads, {} frames "
+               "after {} to warm up",
+               JobCount, threads, Frames, WarmupFrames);
+  fmt::println("Allocations: {} in total, at most {} in a frame", total,
+               worst);
+  if (total != 0) {
+    fmt::println(stderr, "FAIL: adding jobs allocated in the steady state");
+    return 1;
+  }
+  fmt::println("PASS");
+  return 0;
+}
@@ -0,0 +1,214 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+#include <fmt/base.h>
+
+#include "ecs/registry.hpp"
+#include "ecs/transformstreams.hpp"
+#include "threadpool.hpp"
+
+namespace selwonk {
+
+namespace {
+// Roughly a microsecond of work that the compiler can't optimise away
+uint64_t busyWork(uint64_t seed) {
+  for (int i = 0; i < 256; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+  }
+  return seed;
+}
+} // namespace
+
+void Benchmark::threadPoolScaling() {
+  const static constexpr int JobCount = 200000;
+  const static constexpr int Repeats = 5;
+
+  unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  fmt::println("ThreadPool scaling, {} jobs, best of {}", JobCount, Repeats);
+  fmt::println("{:>8} {:>12} {:>14} {:>8}", "Threads", "Time (ms)",
+               "Jobs/s", "Speedup");
+
+  double baseline = 0;
+  for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+    // The calling thread helps in awaitAll, so spawn one fewer worker
+    ThreadPool pool(threads - 1);
+    std::atomic<uint64_t> sink = 0;
+
+    auto best = std::chrono::steady_clock::duration::max();
+    for (int r = 0; r < Repeats; r++) {
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < JobCount; i++) {
+        pool.addJob([&sink, i] {
+          sink.fetch_add(busyWork(i), std::memory_order_relaxed);
+        });
+      }
+      pool.awaitAll();
+      best = std::min(best, std::chrono::steady_clock::now() - start);
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(best).count();
+    if (threads == 1)
+      baseline = ms;
+    fmt::println("{:>8} {:>12.2f} {:>14.0f} {:>7.2f}x", threads, ms,
+                 JobCount / (ms / 1000.0), baseline / ms);
+  }
+}
+
+void Benchmark::ecsScaling() {
+  const static constexpr int EntityCount = 1000000;
+  const static constexpr int Repeats = 5;
+
+  // Spin each transform around its own axis, and move it forwards
+  auto spin = glm::angleAxis(0.01f, glm::vec3(0, 1, 0));
+  auto update = [&spin](ecs::EntityRef entity, ecs::Transform& transform) {
+    transform.mRotation = glm::normalize(spin * transform.mRotation);
+    transform.mTranslation += transform.mRotation * glm::vec3(0, 0, 0.01f);
+  };
+
+  // Touches two components, on the half of entities that have both
+  float checksum = 0;
+  auto sum = [&checksum](ecs::EntityRef entity, ecs::Transform& transform,
+                         ecs::Renderable& renderable) {
+    if (renderable.mMesh == nullptr)
+      checksum += transform.mTranslation.x;
+  };
+
+  auto time = [](auto&& func) {
+    auto best = std::chrono::steady_clock::duration::max();
+    for (int r = 0; r < Repeats; r++) {
+      auto start = std::chrono::steady_clock::now();
+      func();
+      best = std::min(best, std::chrono::steady_clock::now() - start);
+    }
+    return std::chrono::duration<double, std::milli>(best).count();
+  };
+
+  unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  for (auto storage :
+       {ecs::StorageMode::Arrays, ecs::StorageMode::Archetypes}) {
+    // The same scene for each storage mode
+    ecs::Registry registry(storage);
+    for (int i = 0; i < EntityCount; i++) {
+      auto entity = registry.createEntity();
+      registry.addComponent(entity, ecs::Transform{
+                                        .mTranslation = glm::vec3(i, 0, 0),
+                                    });
+      if (i % 2 == 0)
+        registry.addComponent(entity, ecs::Renderable{});
+    }
+
+    const char* name =
+        storage == ecs::StorageMode::Arrays ? "Arrays" : "Archetypes";
+
+    // Creating the same components one at a time, and in bulk
+    std::vector<ecs::Transform> transforms(EntityCount);
+    for (int i = 0; i < EntityCount; i++) {
+      transforms[i].mTranslation = glm::vec3(i, 0, 0);
+    }
+    double singleMs = time([&] {
+      ecs::Registry spawned(storage);
+      for (int i = 0; i < EntityCount; i++) {
+        auto entity = spawned.createEntity();
+        spawned.addComponent(entity, transforms[i]);
+        spawned.addComponent(entity, ecs::Renderable{});
+      }
+    });
+    double bulkMs = time([&] {
+      ecs::Registry spawned(storage);
+      auto entities = spawned.createEntities(EntityCount);
+      spawned.addComponents<ecs::Transform>(entities, transforms);
+      spawned.addComponents(entities, ecs::Renderable{});
+    });
+    fmt::println("{}: Spawn {} entities, one by one {:.2f}ms, in bulk {:.2f}ms",
+                 name, EntityCount, singleMs, bulkMs);
+
+    double forEachMs = time([&] {
+      registry.forEach<ecs::Transform, ecs::Renderable>(sum);
+    });
+    fmt::println("{}: Registry::forEach over {} of {} entities {:.2f}ms", name,
+                 EntityCount / 2, EntityCount, forEachMs);
+
+    fmt::println("{}: Registry::parallelForEach scaling, {} transforms, best "
+                 "of {}",
+                 name, EntityCount, Repeats);
+    fmt::println("{:>8} {:>12} {:>14} {:>8}", "Threads", "Time (ms)",
+                 "Entities/s", "Speedup");
+
+    double baseline = 0;
+    for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+      ThreadPool pool(threads - 1);
+      double ms =
+          time([&] { registry.parallelForEach<ecs::Transform>(update); });
+      if (threads == 1)
+        baseline = ms;
+      fmt::println("{:>8} {:>12.2f} {:>14.0f} {:>7.2f}x", threads, ms,
+                   EntityCount / (ms / 1000.0), baseline / ms);
+    }
+  }
+}
+
+void Benchmark::transformMatrices() {
+  const static constexpr int TransformCount = 1000000;
+  const static constexpr int Repeats = 10;
+
+  // Fixed seed, so every run converts the same transforms
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<ecs::Transform> transforms(TransformCount);
+  ecs::TransformStreams streams;
+  for (auto& transform : transforms) {
+    transform.mTranslation =
+        glm::vec3(dist(rng), dist(rng), dist(rng)) * 100.0f;
+    transform.mRotation = glm::normalize(
+        glm::quat(dist(rng), dist(rng), dist(rng), dist(rng)));
+    transform.mScale = glm::vec3(dist(rng), dist(rng), dist(rng)) + 2.0f;
+    streams.push(transform);
+  }
+
+  auto time = [](auto&& func) {
+    auto best = std::chrono::steady_clock::duration::max();
+    for (int r = 0; r < Repeats; r++) {
+      auto start = std::chrono::steady_clock::now();
+      func();
+      best = std::min(best, std::chrono::steady_clock::now() - start);
+    }
+    return std::chrono::duration<double, std::milli>(best).count();
+  };
+
+  std::vector<glm::mat4> scalar(TransformCount);
+  std::vector<glm::mat4> batched(TransformCount);
+  double scalarMs = time([&] {
+    for (int i = 0; i < TransformCount; i++) {
+      scalar[i] = transforms[i].modelMatrix();
+    }
+  });
+  double batchedMs = time([&] { streams.toMatrices(batched); });
+
+  float maxError = 0;
+  for (int i = 0; i < TransformCount; i++) {
+    for (int column = 0; column < 4; column++) {
+      auto difference = glm::abs(scalar[i][column] - batched[i][column]);
+      maxError = std::max({maxError, difference.x, difference.y, difference.z,
+                           difference.w});
+    }
+  }
+
+  fmt::println("Transform to matrix, {} transforms, best of {}", TransformCount,
+               Repeats);
+  fmt::println("{:>24} {:>12} {:>14}", "Path", "Time (ms)", "ns/transform");
+  fmt::println("{:>24} {:>12.2f} {:>14.2f}", "Transform::modelMatrix",
+               scalarMs, scalarMs * 1e6 / TransformCount);
+  fmt::println("{:>24} {:>12.2f} {:>14.2f}", "TransformStreams", batchedMs,
+               batchedMs * 1e6 / TransformCount);
+  fmt::println("Speedup {:.2f}x, max difference {}", scalarMs / batchedMs,
+               maxError);
+}
+
+} // namespace selwonk
@@ -0,0 +1,21 @@
+#pragma once
+
+namespace selwonk {
+// Standalone benchmarks that run from the command line, without a window or
+// GPU. Results are printed to stdout
+class Benchmark {
+public:
+  // Measure ThreadPool throughput on fine-grained jobs using 1..N threads,
+  // where N is the number of hardware threads
+  static void threadPoolScaling();
+  // Measure Registry::parallelForEach over a million transforms using 1..N
+  // threads, and forEach over two components, with each StorageMode
+  static void ecsScaling();
+  // Compare Transform::modelMatrix against TransformStreams::toMatrices for a
+  // million transforms on a single thread
+  static void transformMatrices();
+
+private:
+  Benchmark() = delete;
+};
+} // namespace selwonk
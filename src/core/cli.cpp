@@ -12,6 +12,43 @@ Cli::Cli(int argc, char** argv) {
       "Run for the specified number of frames, then quit",
       &quitAfterFrames,
   });
+  parser.addOption({
+      "-bt",
+      "--bench-threadpool",
+      "Benchmark thread pool scaling across core counts, then exit",
+      &benchThreadPool,
+  });
+  parser.addOption({
+      "-be",
+      "--bench-ecs",
+      "Benchmark parallel ECS iteration across core counts, then exit",
+      &benchEcs,
+  });
+  parser.addOption({
+      "-bx",
+      "--bench-transforms",
+      "Benchmark batched transform to matrix conversion, then exit",
+      &benchTransforms,
+  });
+  parser.addOption({
+      "-pt",
+      "--pin-threads",
+      "Pin each job thread to its own CPU core",
+      &pinThreads,
+  });
+  parser.addOption({
+      "-ar",
+      "--archetypes",
+      "Store ECS components in archetype tables rather than per-type arrays",
+      &archetypes,
+  });
+  parser.addOption({
+      "-ss",
+      "--snapshot",
+      "Load the scene from an ECS snapshot file, or save one there if it does "
+      "not exist",
+      &snapshot,
+  });
 
   parser.parse(argc, argv);
 }
@@ -28,6 +65,11 @@ int Cli::Option::parse(int argc, char** argv) {
         throw std::runtime_error("Expected a value");
       *option = std::stoi(argv[1]);
       return 2;
+    } else if constexpr (std::is_same_v<T, std::optional<std::string>*>) {
+      if (argc < 2)
+        throw std::runtime_error("Expected a value");
+      *option = argv[1];
+      return 2;
     } else {
       static_assert(false, "non-exhaustive visitor");
     }
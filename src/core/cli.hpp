@@ -2,6 +2,7 @@
 
 #include <map>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <variant>
 #include <vector>
@@ -15,7 +16,9 @@ public:
     std::string_view longName;
     std::string_view description;
 
-    std::variant<std::optional<unsigned int>*, bool*> target;
+    std::variant<std::optional<unsigned int>*, std::optional<std::string>*,
+                 bool*>
+        target;
 
     // Parse an argument, given the argument and all following parameters
     // Return the number of consumed parameters
@@ -44,6 +47,12 @@ public:
 
   bool help;
   std::optional<unsigned int> quitAfterFrames;
+  bool benchThreadPool = false;
+  bool benchEcs = false;
+  bool benchTransforms = false;
+  bool pinThreads = false;
+  bool archetypes = false;
+  std::optional<std::string> snapshot;
 
   Parser parser;
 };
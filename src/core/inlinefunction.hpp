@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace selwonk::core {
+
+// A type-erased `void()` callable stored in a fixed-size buffer. Unlike
+// std::function, this never allocates memory, and callables that do not fit
+// are rejected at compile time
+// Cannot be copied or moved, as the stored callable may not support either
+template <size_t Capacity> class InlineFunction {
+public:
+  // Can a callable of type F be stored?
+  template <typename F>
+  const static constexpr bool fits =
+      sizeof(std::decay_t<F>) <= Capacity &&
+      alignof(std::decay_t<F>) <= alignof(std::max_align_t);
+
+  InlineFunction() = default;
+  ~InlineFunction() { reset(); }
+
+  // Store a new callable, destroying the previous one if any
+  template <typename F> void emplace(F&& func) {
+    using Stored = std::decay_t<F>;
+    static_assert(fits<F>, "Callable is too large for InlineFunction");
+    static_assert(std::is_invocable_v<Stored&>, "Callable must be void()");
+
+    reset();
+    new (mStorage) Stored(std::forward<F>(func));
+    mInvoke = [](void* storage) { (*static_cast<Stored*>(storage))(); };
+    // Skip the indirect call for the common case of trivial captures
+    if constexpr (!std::is_trivially_destructible_v<Stored>) {
+      mDestroy = [](void* storage) { static_cast<Stored*>(storage)->~Stored(); };
+    }
+  }
+
+  // Destroy the stored callable, if any
+  void reset() {
+    if (mDestroy != nullptr)
+      mDestroy(mStorage);
+    mInvoke = nullptr;
+    mDestroy = nullptr;
+  }
+
+  void operator()() { mInvoke(mStorage); }
+  explicit operator bool() const { return mInvoke != nullptr; }
+
+  InlineFunction(const InlineFunction&) = delete;
+  InlineFunction& operator=(const InlineFunction&) = delete;
+
+private:
+  alignas(std::max_align_t) std::byte mStorage[Capacity];
+  void (*mInvoke)(void*) = nullptr;
+  void (*mDestroy)(void*) = nullptr;
+};
+
+} // namespace selwonk::core
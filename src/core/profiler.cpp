@@ -1,6 +1,9 @@
 #include "profiler.hpp"
 
+#include <cassert>
+
 #include <fmt/base.h>
+#include <fmt/format.h>
 #include <imgui.h>
 #include <tracy/Tracy.hpp>
 
@@ -8,6 +11,8 @@ namespace selwonk::core {
 void Profiler::beginFrame() {
   mNextSectionIndex = 0;
   mLastSectionEnd = Clock::now();
+  mFrameTime = mLastSectionEnd - mFrameStart;
+  mFrameStart = mLastSectionEnd;
   FrameMark;
 }
 
@@ -42,10 +47,103 @@ void Profiler::printTimes() {
 
     auto framerate = 1000.0f * 1000.0f / us.count();
     ImGui::LabelText("Framerate", "%.0ffps", framerate);
+
+    printWorkers();
   }
   ImGui::End();
 }
 
+float Profiler::framePercent(ThreadPool::Clock::duration duration) const {
+  using Seconds = std::chrono::duration<float>;
+  if (mFrameTime.count() <= 0)
+    return 0.0f;
+  return 100.0f * Seconds(duration).count() / Seconds(mFrameTime).count();
+}
+
+void Profiler::recordWorkers(std::span<const ThreadPool::WorkerStats> workers) {
+  mWorkers.assign(workers.begin(), workers.end());
+
+  if (mWorkerPlots.empty()) {
+    mWorkerPlots.resize(workers.size());
+    for (size_t i = 0; i < workers.size(); i++) {
+      mWorkerPlots[i] = {
+          .mBusy = fmt::format("Thread {} busy", i),
+          .mQueueDepth = fmt::format("Thread {} queued", i),
+      };
+      TracyPlotConfig(mWorkerPlots[i].mBusy.c_str(),
+                      tracy::PlotFormatType::Percentage, false, true, 0);
+    }
+  }
+  assert(mWorkerPlots.size() == workers.size() &&
+         "Thread count changed between frames");
+
+  size_t jobs = 0;
+  size_t steals = 0;
+  size_t queued = 0;
+  ThreadPool::Clock::duration lockWait{};
+  for (size_t i = 0; i < workers.size(); i++) {
+    auto& worker = workers[i];
+    jobs += worker.jobs;
+    steals += worker.steals;
+    queued += worker.queueDepth;
+    lockWait += worker.lockWait;
+
+    TracyPlot(mWorkerPlots[i].mBusy.c_str(), framePercent(worker.busy));
+    TracyPlot(mWorkerPlots[i].mQueueDepth.c_str(),
+              static_cast<int64_t>(worker.queueDepth));
+  }
+  TracyPlot("Jobs", static_cast<int64_t>(jobs));
+  TracyPlot("Steals", static_cast<int64_t>(steals));
+  using Micros = std::chrono::duration<double, std::micro>;
+  TracyPlot("Lock wait (us)", Micros(lockWait).count());
+  mQueueDepth.record(static_cast<float>(queued));
+}
+
+void Profiler::printWorkers() {
+  if (mWorkers.empty() || !ImGui::CollapsingHeader("Workers"))
+    return;
+
+  ImGui::PlotLines("Queued jobs", mQueueDepth.data(), Samples,
+                   static_cast<int>(mQueueDepth.offset()));
+
+  if (ImGui::BeginTable("Workers", 7,
+                        ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+    for (auto* name :
+         {"Thread", "Jobs", "Steals", "Busy", "Idle", "Lock", "Queued"}) {
+      ImGui::TableSetupColumn(name);
+    }
+    ImGui::TableHeadersRow();
+
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+      auto& worker = mWorkers[i];
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      // See ThreadPool::workerStats for the order
+      if (i == 0)
+        ImGui::Text("Main");
+      else if (i == mWorkers.size() - 1)
+        ImGui::Text("Other");
+      else
+        ImGui::Text("Worker %zu", i);
+      ImGui::TableNextColumn();
+      ImGui::Text("%zu", worker.jobs);
+      ImGui::TableNextColumn();
+      ImGui::Text("%zu", worker.steals);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.0f%%", framePercent(worker.busy));
+      ImGui::TableNextColumn();
+      ImGui::Text("%.0f%%", framePercent(worker.idle));
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3fms", std::chrono::duration<float, std::milli>(
+                                worker.lockWait)
+                                .count());
+      ImGui::TableNextColumn();
+      ImGui::Text("%zu", worker.queueDepth);
+    }
+    ImGui::EndTable();
+  }
+}
+
 void Profiler::startSection(std::string_view name) {
   if (mMetrics.size() <= mNextSectionIndex) {
     mMetrics.emplace_back();
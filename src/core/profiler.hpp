@@ -1,8 +1,12 @@
 #pragma once
 
 #include <chrono>
+#include <span>
+#include <string>
 #include <string_view>
+#include <vector>
 
+#include "../threadpool.hpp"
 #include "ringbuffer.hpp"
 #include "singleton.hpp"
 
@@ -27,6 +31,10 @@ public:
   // Begin recording a new section
   void startSection(std::string_view name);
 
+  // Record thread pool activity over the previous frame, as returned by
+  // ThreadPool::workerStats. Shown over ImGui and plotted in Tracy
+  void recordWorkers(std::span<const ThreadPool::WorkerStats> workers);
+
 private:
   const static constexpr int Samples = 128;
   struct Metric {
@@ -38,9 +46,27 @@ private:
   // current frame
   Clock::duration getElapsed();
 
+  // Tracy identifies plots by the address of their name, so these must not
+  // move once created
+  struct WorkerPlots {
+    std::string mBusy;
+    std::string mQueueDepth;
+  };
+
+  void printWorkers();
+  // Get a duration as a percentage of the previous frame
+  float framePercent(ThreadPool::Clock::duration duration) const;
+
   std::vector<Metric> mMetrics;
   Metrics mExtraMetrics;
   size_t mNextSectionIndex = 0;
   Clock::time_point mLastSectionEnd;
+  Clock::time_point mFrameStart;
+  Clock::duration mFrameTime{};
+
+  std::vector<ThreadPool::WorkerStats> mWorkers;
+  std::vector<WorkerPlots> mWorkerPlots;
+  // Total jobs queued at the end of each frame
+  RingBuffer<float, Samples> mQueueDepth;
 };
 } // namespace selwonk::core
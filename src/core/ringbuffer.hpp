@@ -20,8 +20,12 @@ public:
     return sum / Count;
   }
 
+  // Raw samples, starting from the oldest at offset()
+  const T* data() const { return mSamples.data(); }
+  size_t offset() const { return mIndex; }
+
 private:
   size_t mIndex = 0;
-  std::array<T, Count> mSamples;
+  std::array<T, Count> mSamples{};
 };
 } // namespace selwonk::core
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace selwonk::core {
+// Lock-free work-stealing deque, based on the Chase-Lev deque as described in
+// "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al. 2013)
+//
+// A single owner thread pushes and pops at the bottom in LIFO order, which
+// keeps recently created (and likely cache-hot) work local. Any other thread
+// may steal from the top in FIFO order.
+//
+// T must be trivially copyable, and is expected to be a pointer
+template <typename T> class StealQueue {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "StealQueue elements must be trivially copyable");
+
+public:
+  explicit StealQueue(size_t capacity = 1024) {
+    assert((capacity & (capacity - 1)) == 0 &&
+           "Capacity must be a power of two");
+    mRetired.emplace_back(std::make_unique<Buffer>(capacity));
+    mBuffer.store(mRetired.back().get(), std::memory_order_relaxed);
+  }
+
+  // Push an item to the bottom of the queue. Owner thread only
+  void push(T item) {
+    int64_t bottom = mBottom.load(std::memory_order_relaxed);
+    int64_t top = mTop.load(std::memory_order_acquire);
+    Buffer* buffer = mBuffer.load(std::memory_order_relaxed);
+    if (bottom - top > static_cast<int64_t>(buffer->capacity()) - 1) {
+      buffer = grow(buffer, top, bottom);
+    }
+    buffer->store(bottom, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    mBottom.store(bottom + 1, std::memory_order_relaxed);
+  }
+
+  // Pop the most recently pushed item. Owner thread only
+  std::optional<T> pop() {
+    int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+    Buffer* buffer = mBuffer.load(std::memory_order_relaxed);
+    mBottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = mTop.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+      // Empty, restore the bottom
+      mBottom.store(bottom + 1, std::memory_order_relaxed);
+      return std::nullopt;
+    }
+
+    T item = buffer->load(bottom);
+    if (top == bottom) {
+      // Last item, race against thieves for it
+      bool won = mTop.compare_exchange_strong(top, top + 1,
+                                              std::memory_order_seq_cst,
+                                              std::memory_order_relaxed);
+      mBottom.store(bottom + 1, std::memory_order_relaxed);
+      if (!won)
+        return std::nullopt;
+    }
+    return item;
+  }
+
+  // Steal the least recently pushed item. Safe to call from any thread
+  // May spuriously fail if another thread wins the race for the same item
+  std::optional<T> steal() {
+    int64_t top = mTop.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = mBottom.load(std::memory_order_acquire);
+
+    if (top >= bottom)
+      return std::nullopt;
+
+    Buffer* buffer = mBuffer.load(std::memory_order_acquire);
+    T item = buffer->load(top);
+    if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return std::nullopt;
+    }
+    return item;
+  }
+
+  // Grow the queue to hold at least `capacity` items. Owner thread only
+  void reserve(size_t capacity) {
+    Buffer* buffer = mBuffer.load(std::memory_order_relaxed);
+    int64_t bottom = mBottom.load(std::memory_order_relaxed);
+    int64_t top = mTop.load(std::memory_order_acquire);
+    while (buffer->capacity() < capacity) {
+      buffer = grow(buffer, top, bottom);
+    }
+  }
+
+  // Approximate number of items in the queue. May be stale by the time it is
+  // read
+  size_t size() const {
+    int64_t bottom = mBottom.load(std::memory_order_relaxed);
+    int64_t top = mTop.load(std::memory_order_relaxed);
+    return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+  }
+  bool empty() const { return size() == 0; }
+
+  // No copy/move, thieves hold a reference
+  StealQueue(const StealQueue&) = delete;
+  StealQueue& operator=(const StealQueue&) = delete;
+
+private:
+  class Buffer {
+  public:
+    Buffer(size_t capacity)
+        : mMask(capacity - 1),
+          mData(std::make_unique<std::atomic<T>[]>(capacity)) {}
+
+    size_t capacity() const { return mMask + 1; }
+    // Slots use acquire/release rather than relying solely on the fences
+    // below. This costs nothing on x86, and keeps ThreadSanitizer happy
+    T load(int64_t index) const {
+      return mData[index & mMask].load(std::memory_order_acquire);
+    }
+    void store(int64_t index, T value) {
+      mData[index & mMask].store(value, std::memory_order_release);
+    }
+
+  private:
+    size_t mMask;
+    std::unique_ptr<std::atomic<T>[]> mData;
+  };
+
+  // Double the capacity of the buffer. The old buffer is kept alive until the
+  // queue is destroyed, as a thief may still be reading from it
+  Buffer* grow(Buffer* old, int64_t top, int64_t bottom) {
+    auto bigger = std::make_unique<Buffer>(old->capacity() * 2);
+    for (int64_t i = top; i < bottom; i++) {
+      bigger->store(i, old->load(i));
+    }
+    Buffer* ptr = bigger.get();
+    mRetired.emplace_back(std::move(bigger));
+    mBuffer.store(ptr, std::memory_order_release);
+    return ptr;
+  }
+
+  // Keep the indices on separate cache lines, the owner writes to the bottom
+  // while thieves write to the top
+  alignas(64) std::atomic<int64_t> mTop = 0;
+  alignas(64) std::atomic<int64_t> mBottom = 0;
+  std::atomic<Buffer*> mBuffer;
+  // Every buffer ever allocated, including the current one. Owner only
+  std::vector<std::unique_ptr<Buffer>> mRetired;
+};
+} // namespace selwonk::core
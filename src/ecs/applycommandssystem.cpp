@@ -1,15 +1,68 @@
 #include "applycommandssystem.hpp"
 
+#include <algorithm>
+
 #include "registry.hpp"
 
 namespace selwonk::ecs {
 
 void ApplyCommandsSystem::update(ecs::Registry& ecs, Duration dt) {
-  auto& queue = ecs.getQueuedCommands();
-  for (auto& cmd : queue) {
-    std::visit([&](auto& val) { val.apply(ecs); }, cmd);
+  mCoalesced = 0;
+  Registry::CommandBuffer::forEachType([&]<typename C>(std::type_identity<C>) {
+    applyAll<C>(ecs);
+  });
+}
+
+template <typename C> void ApplyCommandsSystem::applyAll(Registry& ecs) {
+  for (auto& buffer : ecs.getCommandBuffers()) {
+    auto& commands = buffer->get<C>();
+    if constexpr (requires(C command) { command.mTarget; }) {
+      // Walk from newest to oldest, so the first command seen for an entity is
+      // the last one queued. Survivors are then applied in queue order
+      nextStamp();
+      mSkipped.assign(commands.size(), false);
+      for (size_t i = commands.size(); i-- > 0;) {
+        if (!firstApplied(commands[i].mTarget)) {
+          mSkipped[i] = true;
+          mCoalesced++;
+        }
+      }
+      for (size_t i = 0; i < commands.size(); i++) {
+        if (!mSkipped[i])
+          commands[i].apply(ecs);
+      }
+    } else {
+      for (auto& command : commands) {
+        command.apply(ecs);
+      }
+    }
+    commands.clear();
+  }
+}
+
+void ApplyCommandsSystem::nextStamp() {
+  mStamp++;
+  if (mStamp == 0) {
+    std::ranges::fill(mApplied, Applied{});
+    mStamp = 1;
+  }
+  if (!mAppliedReused.empty())
+    mAppliedReused.clear();
+}
+
+bool ApplyCommandsSystem::firstApplied(EntityRef target) {
+  auto id = target.id();
+  if (mApplied.size() <= id)
+    mApplied.resize(id + 1);
+
+  auto& applied = mApplied[id];
+  if (applied.mStamp != mStamp) {
+    applied = {.mStamp = mStamp, .mGeneration = target.generation()};
+    return true;
   }
-  queue.clear();
+  if (applied.mGeneration == target.generation())
+    return false;
+  return mAppliedReused.insert(target).second;
 }
 
 } // namespace selwonk::ecs
@@ -1,10 +1,50 @@
 #pragma once
 
+#include <cstdint>
+#include <span>
+#include <unordered_set>
+#include <vector>
+
+#include "entity.hpp"
 #include "system.hpp"
 
 namespace selwonk::ecs {
+// Applies the command buffers of every thread, one type of command at a time.
+// Within a buffer, earlier commands of a type to an entity are overwritten by
+// later ones, so are skipped, and the rest are applied in the order they were
+// queued. Buffers are not coalesced with each other, as there is no order
+// between threads to decide which command came last. Commands without a target
+// are all applied
 class ApplyCommandsSystem : public System {
+public:
   void update(Registry& ecs, Duration dt) override;
   std::string_view name() const noexcept override { return "ApplyCommands"; }
+
+  // Commands skipped at the last barrier, as a later one replaced them
+  size_t coalesced() const { return mCoalesced; }
+
+private:
+  template <typename C> void applyAll(Registry& ecs);
+  // Start a new buffer or command type, forgetting what was applied
+  void nextStamp();
+  // Is this the first command of the current stamp to the target?
+  bool firstApplied(EntityRef target);
+
+  struct Applied {
+    uint32_t mStamp = 0;
+    EntityRef::Generation mGeneration = 0;
+  };
+
+  // Stamp of the buffer and command type being applied, so that mApplied never
+  // needs clearing
+  uint32_t mStamp = 0;
+  // The last stamp and generation applied to each entity ID
+  std::vector<Applied> mApplied;
+  // Entities applied under the current stamp whose ID was already taken by
+  // another generation, as an ID can be destroyed and reused before a barrier
+  std::unordered_set<EntityRef> mAppliedReused;
+  // Commands in the current buffer replaced by a later one
+  std::vector<bool> mSkipped;
+  size_t mCoalesced = 0;
 };
 } // namespace selwonk::ecs
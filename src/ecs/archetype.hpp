@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <tuple>
+#include <vector>
+
+#include "component.hpp"
+#include "entity.hpp"
+
+namespace selwonk::ecs {
+// Table of every entity with exactly the same components and flags. Each
+// component has its own column (structure of arrays), and rows are kept packed
+// so iterating a column is a linear walk through memory
+template <typename... Components> class Archetype {
+public:
+  explicit Archetype(ComponentMask mask) : mMask(mask) {}
+
+  const ComponentMask& mask() const { return mMask; }
+  size_t size() const { return mEntities.size(); }
+  // Entity in each row
+  std::span<const EntityRef::Id> entities() const { return mEntities; }
+
+  // Components of each row, indexed by row. Tags have no column, so every row
+  // shares the tag's single value
+  template <typename T> auto column() {
+    assert(mMask.hasComponent(T::Type) && "Table does not have this component");
+    if constexpr (TagComponent<T>)
+      return typename T::Store::ChunkView();
+    else
+      return std::span<T>(std::get<std::vector<T>>(mColumns));
+  }
+
+  // Add a row with default constructed components, returning its index
+  uint32_t push(EntityRef::Id entity) {
+    mEntities.push_back(entity);
+    forEachColumn([](auto& column) { column.emplace_back(); });
+    return static_cast<uint32_t>(mEntities.size() - 1);
+  }
+
+  // Copy a row into another table, moving components present in both. The
+  // row is left in place, and must be removed afterwards
+  uint32_t moveRow(uint32_t row, Archetype& to) {
+    auto newRow = to.push(mEntities[row]);
+    forEachColumn([&](auto& column) {
+      using T = std::decay_t<decltype(column)>::value_type;
+      if (to.mMask.hasComponent(T::Type))
+        to.template column<T>()[newRow] = std::move(column[row]);
+    });
+    return newRow;
+  }
+
+  // Remove a row, moving the last into its place. Returns the entity that was
+  // moved, if any
+  std::optional<EntityRef::Id> remove(uint32_t row) {
+    auto last = static_cast<uint32_t>(mEntities.size() - 1);
+    std::optional<EntityRef::Id> moved;
+    if (row != last) {
+      mEntities[row] = mEntities[last];
+      forEachColumn(
+          [&](auto& column) { column[row] = std::move(column[last]); });
+      moved = mEntities[row];
+    }
+    mEntities.pop_back();
+    forEachColumn([](auto& column) { column.pop_back(); });
+    return moved;
+  }
+
+private:
+  // Call f(column) for every component in the table, except tags
+  template <typename F> void forEachColumn(F&& f) {
+    auto visit = [&]<typename T>(std::vector<T>& column) {
+      if constexpr (!TagComponent<T>) {
+        if (mMask.hasComponent(T::Type))
+          f(column);
+      }
+    };
+    std::apply([&](auto&... columns) { (visit(columns), ...); }, mColumns);
+  }
+
+  ComponentMask mMask;
+  std::vector<EntityRef::Id> mEntities;
+  // Columns for components not in the mask, and for tags, are left empty
+  std::tuple<std::vector<Components>...> mColumns;
+};
+
+// Alternative to storing each component in its own array, where entities are
+// grouped into an Archetype per distinct mask. Components used together are
+// stored together, and iteration only has to find the matching tables rather
+// than test every entity. Adding or removing components, or enabling or
+// disabling an entity, moves it to another table
+// Takes the registry's ComponentArrayTuple to determine which components exist
+template <typename Stores> class ArchetypeStorage;
+template <typename... Stores> class ArchetypeStorage<std::tuple<Stores...>> {
+public:
+  using Table = Archetype<typename Stores::ValueType...>;
+
+  // Move an entity to the table for its new mask, keeping the components
+  // present in both. Added components are default constructed. Entities that
+  // are no longer alive are removed from every table
+  void setMask(EntityRef::Id entity, ComponentMask mask) {
+    if (mLocations.size() <= entity)
+      mLocations.resize(entity + 1);
+    auto from = mLocations[entity];
+    bool alive = mask.hasFlag(EntityFlag::Alive);
+
+    if (from.mTable == NoTable) {
+      if (!alive)
+        return;
+      auto table = getTable(mask);
+      mLocations[entity] = {table, mTables[table]->push(entity)};
+      return;
+    }
+    if (mTables[from.mTable]->mask() == mask)
+      return;
+
+    if (alive) {
+      auto table = getTable(mask);
+      auto row = mTables[from.mTable]->moveRow(from.mRow, *mTables[table]);
+      mLocations[entity] = {table, row};
+    } else {
+      mLocations[entity] = {};
+    }
+    removeRow(from);
+  }
+
+  template <typename T> T& get(EntityRef::Id entity) {
+    auto location = mLocations[entity];
+    return mTables[location.mTable]->template column<T>()[location.mRow];
+  }
+
+  // Call f(table) for every non-empty table whose mask matches
+  template <typename F> void forEachTable(ComponentMask mask, F&& f) {
+    for (auto& table : mTables) {
+      if (table->size() > 0 && table->mask().matches(mask))
+        f(*table);
+    }
+  }
+
+  size_t tableCount() const { return mTables.size(); }
+
+private:
+  const static constexpr uint32_t NoTable =
+      std::numeric_limits<uint32_t>::max();
+
+  struct Location {
+    uint32_t mTable = NoTable;
+    uint32_t mRow = 0;
+  };
+
+  // Get the index of the table for a mask, creating it if needed
+  // There are few distinct masks in practice, so a linear search is fine
+  uint32_t getTable(ComponentMask mask) {
+    for (uint32_t i = 0; i < mTables.size(); i++) {
+      if (mTables[i]->mask() == mask)
+        return i;
+    }
+    mTables.emplace_back(std::make_unique<Table>(mask));
+    return static_cast<uint32_t>(mTables.size() - 1);
+  }
+
+  void removeRow(Location location) {
+    if (auto moved = mTables[location.mTable]->remove(location.mRow))
+      mLocations[*moved].mRow = location.mRow;
+  }
+
+  // Tables are never freed, so the index of a mask's table is stable
+  std::vector<std::unique_ptr<Table>> mTables;
+  // Where each entity's components are, indexed by ID
+  std::vector<Location> mLocations;
+};
+} // namespace selwonk::ecs
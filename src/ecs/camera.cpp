@@ -1,6 +1,7 @@
 #include "camera.hpp"
 
 #include "registry.hpp"
+#include "snapshot.hpp"
 
 namespace selwonk::ecs {
 void Camera::SetTarget::apply(Registry& ecs) {
@@ -8,4 +9,20 @@ void Camera::SetTarget::apply(Registry& ecs) {
   component.mDrawTarget = mDraw;
   component.mDepthTarget = mDepth;
 }
+
+void Camera::save(SnapshotWriter& out) const {
+  out.write(mType);
+  out.write(mNear);
+  out.write(mFar);
+  out.write(mFov);
+}
+
+Camera Camera::load(SnapshotReader& in) {
+  return {
+      .mType = in.read<ProjectionType>(),
+      .mNear = in.read<float>(),
+      .mFar = in.read<float>(),
+      .mFov = in.read<float>(),
+  };
+}
 } // namespace selwonk::ecs
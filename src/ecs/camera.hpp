@@ -10,6 +10,8 @@
 
 namespace selwonk::ecs {
 class Registry;
+class SnapshotReader;
+class SnapshotWriter;
 
 struct Camera {
   struct SetTarget;
@@ -30,6 +32,11 @@ struct Camera {
   std::shared_ptr<vulkan::Image> mDrawTarget;
   std::shared_ptr<vulkan::Image> mDepthTarget;
 
+  // Targets belong to the window, so are not saved. Send SetTarget after
+  // loading a snapshot
+  void save(SnapshotWriter& out) const;
+  static Camera load(SnapshotReader& in);
+
   constexpr glm::mat4 getMatrix() const {
     assert(mDrawTarget->getExtent() == mDepthTarget->getExtent() &&
            "Draw and depth targets should be the same size");
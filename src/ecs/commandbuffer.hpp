@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace selwonk::ecs {
+// Commands queued by a single thread, grouped by type so that each type can be
+// applied in a tight loop rather than dispatched one at a time. Every command
+// must have an `apply(Registry&)` method, and commands that modify an existing
+// entity an `EntityRef mTarget`
+// Aligned to a cache line so that threads pushing to their own buffers do not
+// contend
+template <typename... Commands> class alignas(64) CommandBuffer {
+public:
+  template <typename C> void push(C&& command) {
+    using T = std::decay_t<C>;
+    static_assert((std::is_same_v<T, Commands> || ...),
+                  "Command must be listed in Registry::CommandBuffer");
+    get<T>().emplace_back(std::forward<C>(command));
+  }
+
+  template <typename C> std::vector<C>& get() {
+    return std::get<std::vector<C>>(mCommands);
+  }
+
+  bool empty() const {
+    return std::apply(
+        [](const auto&... commands) { return (commands.empty() && ...); },
+        mCommands);
+  }
+  size_t size() const {
+    return std::apply(
+        [](const auto&... commands) { return (commands.size() + ... + 0); },
+        mCommands);
+  }
+
+  // Call f(std::type_identity<C>) for every command type, in the order they
+  // were listed
+  template <typename F> static void forEachType(F&& f) {
+    (f(std::type_identity<Commands>{}), ...);
+  }
+
+private:
+  std::tuple<std::vector<Commands>...> mCommands;
+};
+} // namespace selwonk::ecs
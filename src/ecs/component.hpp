@@ -1,12 +1,25 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <bitset>
+#include <cassert>
 #include <cstdint>
 #include <fmt/base.h>
+#include <limits>
 #include <memory>
-#include <unordered_map>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "../platform.hpp"
 #include "entity.hpp"
 
 namespace selwonk::ecs {
@@ -15,6 +28,9 @@ enum class ComponentType : uint8_t {
   Named,
   Renderable,
   Camera,
+  Parent,
+  Children,
+  WorldTransform,
   Max,
 };
 
@@ -32,30 +48,78 @@ enum class EntityFlag : uint8_t {
   Max,
 };
 
-class ComponentMask {
+// Set of components and flags, with room for at least 256 of them combined
+// Bits are stored in 256-bit blocks, so that matches() and overlaps() compare
+// a whole block with a couple of instructions regardless of how many component
+// types exist
+class alignas(32) ComponentMask {
 public:
   // A mask representing a non-existent entity. Importantly, this does not have
   // the `Alive` flag set.
   consteval static ComponentMask null() { return ComponentMask(); }
+  // A mask with the given components present, and no flags set
+  template <typename... Components> consteval static ComponentMask of() {
+    ComponentMask mask;
+    ((mask.setComponentPresent(Components::Type, true), ...));
+    return mask;
+  }
+  // A mask with every component present, and no flags set
+  consteval static ComponentMask allComponents() {
+    ComponentMask mask;
+    for (size_t i = 0; i < ComponentCount; i++) {
+      mask.setComponentPresent(static_cast<ComponentType>(i), true);
+    }
+    return mask;
+  }
 
   constexpr bool hasComponent(ComponentType type) const {
-    return mData[componentIndex(type)];
+    return getBit(componentIndex(type));
   }
   constexpr void setComponentPresent(ComponentType type, bool value) {
-    mData[componentIndex(type)] = value;
+    setBit(componentIndex(type), value);
   }
 
   constexpr bool hasFlag(EntityFlag flag) const {
-    return mData[flagIndex(flag)];
+    return getBit(flagIndex(flag));
   }
 
   constexpr void setFlag(EntityFlag flag, bool value) {
-    mData[flagIndex(flag)] = value;
+    setBit(flagIndex(flag), value);
   }
 
   // Does this mask have all components and flags as the other mask?
   constexpr bool matches(const ComponentMask& mask) const {
-    return (mData & mask.mData) == mask.mData;
+    if consteval {
+      for (size_t i = 0; i < WordCount; i++) {
+        if ((mWords[i] & mask.mWords[i]) != mask.mWords[i])
+          return false;
+      }
+      return true;
+    } else {
+      for (size_t i = 0; i < WordCount; i += BlockWords) {
+        if (!blockContains(&mWords[i], &mask.mWords[i]))
+          return false;
+      }
+      return true;
+    }
+  }
+  constexpr bool operator==(const ComponentMask& other) const = default;
+
+  // Does this mask share any components or flags with the other mask?
+  constexpr bool overlaps(const ComponentMask& mask) const {
+    if consteval {
+      for (size_t i = 0; i < WordCount; i++) {
+        if ((mWords[i] & mask.mWords[i]) != 0)
+          return true;
+      }
+      return false;
+    } else {
+      for (size_t i = 0; i < WordCount; i += BlockWords) {
+        if (blockIntersects(&mWords[i], &mask.mWords[i]))
+          return true;
+      }
+      return false;
+    }
   }
 
 private:
@@ -66,6 +130,63 @@ private:
     return ComponentStart + static_cast<size_t>(type);
   }
 
+  constexpr bool getBit(size_t index) const {
+    return (mWords[index / WordBits] >> (index % WordBits)) & 1;
+  }
+  constexpr void setBit(size_t index, bool value) {
+    auto bit = uint64_t(1) << (index % WordBits);
+    auto& word = mWords[index / WordBits];
+    word = value ? word | bit : word & ~bit;
+  }
+
+  // Is every bit of `b` set in `a`? Each points to a block of BlockWords
+  static bool blockContains(const uint64_t* a, const uint64_t* b) {
+#if defined(__AVX2__)
+    auto va = _mm256_load_si256(reinterpret_cast<const __m256i*>(a));
+    auto vb = _mm256_load_si256(reinterpret_cast<const __m256i*>(b));
+    return _mm256_testc_si256(va, vb);
+#elif defined(__x86_64__)
+    // SSE2 is always available on x86-64, compare the block as two halves
+    auto lo = _mm_load_si128(reinterpret_cast<const __m128i*>(b));
+    auto hi = _mm_load_si128(reinterpret_cast<const __m128i*>(b + 2));
+    auto andLo =
+        _mm_and_si128(_mm_load_si128(reinterpret_cast<const __m128i*>(a)), lo);
+    auto andHi = _mm_and_si128(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(a + 2)), hi);
+    auto equal =
+        _mm_and_si128(_mm_cmpeq_epi8(andLo, lo), _mm_cmpeq_epi8(andHi, hi));
+    return _mm_movemask_epi8(equal) == 0xFFFF;
+#else
+    uint64_t missing = 0;
+    for (size_t i = 0; i < BlockWords; i++) {
+      missing |= b[i] & ~a[i];
+    }
+    return missing == 0;
+#endif
+  }
+  // Do `a` and `b` have any bits in common?
+  static bool blockIntersects(const uint64_t* a, const uint64_t* b) {
+#if defined(__AVX2__)
+    auto va = _mm256_load_si256(reinterpret_cast<const __m256i*>(a));
+    auto vb = _mm256_load_si256(reinterpret_cast<const __m256i*>(b));
+    return !_mm256_testz_si256(va, vb);
+#elif defined(__x86_64__)
+    auto lo = _mm_and_si128(_mm_load_si128(reinterpret_cast<const __m128i*>(a)),
+                            _mm_load_si128(reinterpret_cast<const __m128i*>(b)));
+    auto hi = _mm_and_si128(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(a + 2)),
+        _mm_load_si128(reinterpret_cast<const __m128i*>(b + 2)));
+    auto zero = _mm_cmpeq_epi8(_mm_or_si128(lo, hi), _mm_setzero_si128());
+    return _mm_movemask_epi8(zero) != 0xFFFF;
+#else
+    uint64_t common = 0;
+    for (size_t i = 0; i < BlockWords; i++) {
+      common |= a[i] & b[i];
+    }
+    return common != 0;
+#endif
+  }
+
   // Total number of component types
   const static constexpr size_t ComponentStart = 0;
   const static constexpr size_t ComponentCount =
@@ -74,83 +195,600 @@ private:
   const static constexpr size_t FlagCount =
       static_cast<size_t>(EntityFlag::Max);
 
-  std::bitset<ComponentCount + FlagCount> mData;
+  const static constexpr size_t WordBits = 64;
+  // Bits per block, the width of an AVX2 register
+  const static constexpr size_t BlockBits = 256;
+  const static constexpr size_t BlockWords = BlockBits / WordBits;
+  // Whole blocks, so that SIMD comparisons never read past the end
+  const static constexpr size_t WordCount =
+      (ComponentCount + FlagCount + BlockBits - 1) / BlockBits * BlockWords;
+
+  std::array<uint64_t, WordCount> mWords = {};
+};
+
+// Occupancy of a component store, for judging its space efficiency
+struct StoreStats {
+  // Number of components stored
+  size_t mCount;
+  // Number of components that fit in the memory allocated
+  size_t mCapacity;
+  // Memory allocated, including any indices
+  size_t mBytes;
+  bool mSparse;
+
+  // Fraction of the capacity in use
+  float occupancy() const {
+    return mCapacity == 0 ? 1.0f : static_cast<float>(mCount) / mCapacity;
+  }
+};
+
+// Components without any data, such as markers, are tags. They are never
+// stored, and only exist as a bit in each entity's ComponentMask
+template <typename T>
+concept TagComponent = std::is_empty_v<T>;
+
+// Store for a TagComponent. Has the same interface as ComponentArray so that
+// tags can be iterated and added like any other component, but allocates
+// nothing, as every entity shares the same empty value
+template <typename T, size_t ChunkSize = 1024> class TagArray {
+public:
+  // Checked here rather than as a constraint, as T is incomplete where it
+  // names its Store
+  static_assert(TagComponent<T>, "Tags must not hold any data");
+  using ValueType = T;
+  const static constexpr bool Sparse = false;
+  const static constexpr size_t EntitiesPerChunk = ChunkSize;
+  const char* getTypeName() const { return T::Name; }
+
+  class ChunkView {
+  public:
+    bool valid() const { return true; }
+    T& operator[](EntityRef::Id entity) const { return sValue; }
+  };
+
+  void add(EntityRef entity, const T& value) { mSize++; }
+  template <typename F>
+  void addRange(EntityRef::Id begin, size_t count, F&& write) {
+    mSize += count;
+  }
+  T& get(EntityRef entity) { return sValue; }
+  void remove(EntityRef entity) { mSize--; }
+  ChunkView chunkView(size_t index) { return ChunkView(); }
+
+  // Get the number of entities with the tag
+  size_t size() const { return mSize; }
+  // Tags never allocate, so there is always room for every entity's
+  size_t capacity() const { return mSize; }
+
+  StoreStats stats() const {
+    return {
+        .mCount = size(),
+        .mCapacity = capacity(),
+        .mBytes = 0,
+        .mSparse = false,
+    };
+  }
+
+private:
+  static inline T sValue;
+
+  size_t mSize = 0;
 };
 
-// Densely packed array of components stored in large contiguous chunks
-// Wasteful for rarely used components. For less common components such as
-// Camera, see SparseComponentArray
+// Array of components stored in large contiguous chunks, indexed directly by
+// entity ID. Wasteful for rarely used components. For less common components
+// such as Camera, see SparseComponentArray
+// Chunks are laid out at fixed offsets in a single range of address space,
+// reserved on first use for EntityRef::MaxEntities components, so the store
+// never moves components as it grows.
+// Chunk memory is committed by the system when first touched and released
+// once empty. Chunks never straddle a huge page, and those that share one are
+// only released together, so that releasing one does not split the page.
+// Slots are only constructed when a component is added, so entities without T
+// hold zeroed or stale bytes
 template <typename T, size_t ChunkSize = 1024> class ComponentArray {
 public:
   using ValueType = T;
+  const static constexpr bool Sparse = false;
+  const static constexpr size_t EntitiesPerChunk = ChunkSize;
   const char* getTypeName() const { return T::Name; }
 
-  void add(EntityRef entity, const T& value) {
-    Chunk& c = getChunk(entity);
-    size_t idx = chunkIdx(entity);
-    c[idx] = value;
+  ComponentArray() = default;
+  ~ComponentArray() { destroyLive(); }
+  // No copy, as the values live in this store's reserved range
+  ComponentArray(const ComponentArray&) = delete;
+  ComponentArray& operator=(const ComponentArray&) = delete;
+  ComponentArray(ComponentArray&& other) noexcept { *this = std::move(other); }
+  ComponentArray& operator=(ComponentArray&& other) noexcept {
+    if (this != &other) {
+      destroyLive();
+      mMemory = std::move(other.mMemory);
+      mStride = other.mStride;
+      mChunksPerGroup = other.mChunksPerGroup;
+      mGroupBytes = other.mGroupBytes;
+      mChunks = std::exchange(other.mChunks, {});
+      mCounts = std::exchange(other.mCounts, {});
+      mLive = std::exchange(other.mLive, {});
+      mSize = std::exchange(other.mSize, 0);
+    }
+    return *this;
+  }
+
+  // Direct access to the components of a single chunk, indexed by entity ID
+  class ChunkView {
+  public:
+    // Is the chunk allocated? If not, no entity in it has T
+    bool valid() const { return mData != nullptr; }
+    T& operator[](EntityRef::Id entity) const { return mData[entity - mBase]; }
 
-#ifdef VN_LOGCOMPONENTSTATS
+  private:
+    friend ComponentArray;
+    ChunkView(T* data, EntityRef::Id base) : mData(data), mBase(base) {}
+
+    T* mData;
+    EntityRef::Id mBase;
+  };
+
+  // Add a component to an entity that does not already have one
+  void add(EntityRef entity, const T& value) {
+    T* c = getChunk(entity);
+    std::construct_at(c + chunkIdx(entity), value);
+    markLive(entity.id(), 1, true);
+    mCounts[entity.id() / ChunkSize]++;
     mSize++;
-#endif
+  }
+  // Add components to `count` consecutive entities starting at `begin`, none of
+  // which have one already. Calls write(destination, offset, n) to fill each
+  // contiguous run of n components, from the offset'th onwards
+  template <typename F>
+  void addRange(EntityRef::Id begin, size_t count, F&& write) {
+    size_t offset = 0;
+    while (offset < count) {
+      auto id = static_cast<EntityRef::Id>(begin + offset);
+      T* c = getChunk(EntityRef(id));
+      size_t idx = id % ChunkSize;
+      size_t n = std::min(count - offset, ChunkSize - idx);
+      // write() assigns, so needs live values to assign to
+      std::uninitialized_default_construct_n(c + idx, n);
+      markLive(id, n, true);
+      write(c + idx, offset, n);
+      mCounts[id / ChunkSize] += n;
+      offset += n;
+    }
+    mSize += count;
   }
   T& get(EntityRef entity) {
-    Chunk& c = getChunk(entity);
-    size_t idx = chunkIdx(entity);
-    return c[idx];
+    auto chunk = entity.id() / ChunkSize;
+    assert(chunk < mChunks.size() && mChunks[chunk] != nullptr &&
+           "Entity does not have this component");
+    return mChunks[chunk][chunkIdx(entity)];
+  }
+  // Remove an entity's component, releasing anything it holds. Chunks are
+  // released once they hold no components
+  void remove(EntityRef entity) {
+    auto chunk = entity.id() / ChunkSize;
+    assert(mCounts[chunk] > 0 && "Removing a component that does not exist");
+    std::destroy_at(mChunks[chunk] + chunkIdx(entity));
+    markLive(entity.id(), 1, false);
+    if (--mCounts[chunk] == 0) {
+      mChunks[chunk] = nullptr;
+      auto group = chunk / mChunksPerGroup;
+      auto first = mChunks.begin() + group * mChunksPerGroup;
+      auto last = mChunks.begin() +
+                  std::min(mChunks.size(), (group + 1) * mChunksPerGroup);
+      if (std::all_of(first, last, [](T* c) { return c == nullptr; }))
+        mMemory.release(group * mGroupBytes, mGroupBytes);
+    }
+    mSize--;
+  }
+
+  // Get the components of entities [index * ChunkSize, (index + 1) * ChunkSize)
+  // Does not allocate, so is safe to call from multiple threads
+  ChunkView chunkView(size_t index) {
+    auto base = static_cast<EntityRef::Id>(index * ChunkSize);
+    if (index >= mChunks.size())
+      return ChunkView(nullptr, base);
+    return ChunkView(mChunks[index], base);
+  }
+
+  // Raw components of a chunk, or nullptr if it is not allocated. Entities
+  // without T hold zeroed or stale bytes
+  const T* chunkData(size_t index) const {
+    if (index >= mChunks.size())
+      return nullptr;
+    return mChunks[index];
+  }
+  // Allocate a chunk that is not in use, returning its storage to be filled
+  // directly. `count` is the number of entities in it that have T
+  T* restoreChunk(size_t index, uint32_t count) {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "Only plain values can be restored as raw bytes");
+    auto first = static_cast<EntityRef::Id>(index * ChunkSize);
+    T* c = getChunk(EntityRef(first));
+    assert(mCounts[index] == 0 && "Chunk is already in use");
+    mCounts[index] = count;
+    mSize += count;
+    return c;
   }
 
-#ifdef VN_LOGCOMPONENTSTATS
   // Get the number of components of this type
   size_t size() const { return mSize; }
 
   // Get the number of components allocated
-  size_t capacity() const { return mChunks.size() * ChunkSize; }
+  size_t capacity() const {
+    return std::count_if(mChunks.begin(), mChunks.end(),
+                         [](auto* chunk) { return chunk != nullptr; }) *
+           ChunkSize;
+  }
 
-#endif
+  StoreStats stats() const {
+    return {
+        .mCount = size(),
+        .mCapacity = capacity(),
+        .mBytes = capacity() / ChunkSize * mStride +
+                  mChunks.capacity() * sizeof(mChunks[0]) +
+                  mCounts.capacity() * sizeof(mCounts[0]) +
+                  mLive.capacity() * sizeof(mLive[0]),
+        .mSparse = false,
+    };
+  }
 
 private:
-  using Chunk = std::array<T, ChunkSize>;
-  std::vector<std::unique_ptr<Chunk>> mChunks;
+  // Enough chunks for every entity ID below EntityRef::MaxEntities. Only
+  // touched chunks use memory
+  const static constexpr size_t MaxChunks =
+      (EntityRef::MaxEntities + ChunkSize - 1) / ChunkSize;
+  // Values that need destroying must be tracked, so the destructor knows
+  // which slots hold one
+  const static constexpr bool TrackLive = !std::is_trivially_destructible_v<T>;
+
+  VirtualMemory mMemory;
+  // Bytes between chunks, rounded up to whole pages
+  size_t mStride = 0;
+  // Chunks are laid out in groups that fill whole huge pages, and a group is
+  // released once all of its chunks are empty. Chunks smaller than a huge page
+  // share one, larger ones are a group of their own
+  size_t mChunksPerGroup = 1;
+  size_t mGroupBytes = 0;
+  // Start of each chunk in mMemory, or nullptr if it holds no components
+  std::vector<T*> mChunks;
+  // Number of components in each chunk
+  std::vector<uint32_t> mCounts;
+  // Slots of each chunk holding a value, only if TrackLive
+  std::vector<std::bitset<ChunkSize>> mLive;
 
-  // Get the chunk index an entity belongs in
-  Chunk& getChunk(EntityRef ent) {
+  // Get the chunk an entity belongs in, committing it if needed
+  T* getChunk(EntityRef ent) {
     auto idx = ent.id() / ChunkSize;
-    if (mChunks.size() <= idx)
+    // Checked in every build, as the chunk would be past the reserved range
+    if (idx >= MaxChunks) [[unlikely]]
+      throw std::out_of_range("Entity ID is above EntityRef::MaxEntities, "
+                              "raise VN_MAXENTITIES to allow more");
+    if (mChunks.size() <= idx) {
       mChunks.resize(idx + 1);
-    if (mChunks[idx] == nullptr)
-      mChunks[idx] = std::make_unique<Chunk>();
-    return *(mChunks[idx].get());
+      mCounts.resize(idx + 1);
+      if constexpr (TrackLive)
+        mLive.resize(idx + 1);
+    }
+    if (mChunks[idx] == nullptr) {
+      if (mMemory.data() == nullptr)
+        reserveChunks();
+      auto offset = idx / mChunksPerGroup * mGroupBytes +
+                    idx % mChunksPerGroup * mStride;
+      mChunks[idx] = reinterpret_cast<T*>(mMemory.data() + offset);
+    }
+    return mChunks[idx];
   }
   // Get an entity's position within its chunk
   size_t chunkIdx(EntityRef ent) { return ent.id() % ChunkSize; }
 
-#ifdef VN_LOGCOMPONENTSTATS
+  // Choose the chunk layout, and reserve enough for MaxChunks
+  void reserveChunks() {
+    auto page = VirtualMemory::pageSize();
+    auto hugePage = VirtualMemory::hugePageSize();
+    auto bytes = sizeof(T) * ChunkSize;
+    if (bytes < hugePage) {
+      mStride = (bytes + page - 1) / page * page;
+      mChunksPerGroup = hugePage / mStride;
+      mGroupBytes = hugePage;
+    } else {
+      mStride = (bytes + hugePage - 1) / hugePage * hugePage;
+      mChunksPerGroup = 1;
+      mGroupBytes = mStride;
+    }
+    auto groups = (MaxChunks + mChunksPerGroup - 1) / mChunksPerGroup;
+    mMemory = VirtualMemory(groups * mGroupBytes);
+  }
+
+  // Record whether `count` slots from `first` hold a value, which must all be
+  // in the same chunk
+  void markLive(EntityRef::Id first, size_t count, bool live) {
+    if constexpr (TrackLive) {
+      auto& bits = mLive[first / ChunkSize];
+      for (size_t i = 0; i < count; i++) {
+        bits[first % ChunkSize + i] = live;
+      }
+    }
+  }
+  void destroyLive() {
+    if constexpr (TrackLive) {
+      for (size_t chunk = 0; chunk < mLive.size(); chunk++) {
+        for (size_t i = 0; i < ChunkSize; i++) {
+          if (mLive[chunk][i])
+            std::destroy_at(mChunks[chunk] + i);
+        }
+      }
+    }
+  }
+
   size_t mSize = 0;
-#endif
 };
 
-// Dictionary of components. Not stored contiguously so lacks cache locality,
-// but avoids wasting memory when few entities have T. Iteration may be faster
-// when N is small relative to the total entity count
-template <typename T> class SparseComponentArray {
+// Sparse set of components. Values are packed densely in no particular order,
+// alongside a paged index from entity ID to position. Lookup is O(1) without
+// hashing, and iteration over values is contiguous. Avoids wasting memory when
+// few entities have T, at the cost of an indirection per lookup
+template <typename T, size_t PageSize = 1024> class SparseComponentArray {
 public:
   using ValueType = T;
+  const static constexpr bool Sparse = true;
   const char* getTypeName() const { return T::Name; }
 
+  // Add a component to an entity that does not already have one
   void add(EntityRef entity, const T& value) {
-    mData.insert(std::make_pair(entity, value));
+    Page& page = getPage(entity.id());
+    auto& slot = page.mIndices[entity.id() % PageSize];
+    assert(slot == NotPresent && "Entity already has this component");
+    slot = static_cast<uint32_t>(mValues.size());
+    page.mCount++;
+    mValues.push_back(value);
+    mEntities.push_back(entity.id());
+  }
+  // Same as ComponentArray::addRange
+  template <typename F>
+  void addRange(EntityRef::Id begin, size_t count, F&& write) {
+    auto first = mValues.size();
+    mValues.resize(first + count);
+    mEntities.reserve(first + count);
+    write(mValues.data() + first, 0, count);
+    for (size_t i = 0; i < count; i++) {
+      auto id = static_cast<EntityRef::Id>(begin + i);
+      Page& page = getPage(id);
+      auto& slot = page.mIndices[id % PageSize];
+      assert(slot == NotPresent && "Entity already has this component");
+      slot = static_cast<uint32_t>(first + i);
+      page.mCount++;
+      mEntities.push_back(id);
+    }
+  }
+  T& get(EntityRef entity) { return mValues[position(entity.id())]; }
+  // Remove an entity's component, moving the last value into its place
+  void remove(EntityRef entity) {
+    auto id = entity.id();
+    auto pageIndex = id / PageSize;
+    auto removed = position(id);
+    auto last = static_cast<uint32_t>(mValues.size() - 1);
+    if (removed != last) {
+      mValues[removed] = std::move(mValues[last]);
+      mEntities[removed] = mEntities[last];
+      mPages[mEntities[removed] / PageSize]
+          ->mIndices[mEntities[removed] % PageSize] = removed;
+    }
+    mValues.pop_back();
+    mEntities.pop_back();
+
+    Page& page = *mPages[pageIndex];
+    page.mIndices[id % PageSize] = NotPresent;
+    if (--page.mCount == 0)
+      mPages[pageIndex].reset();
   }
-  T& get(EntityRef entity) { return mData.find(entity)->second; }
+
+  // Entities with a component, in the same order as values()
+  std::span<const EntityRef::Id> entities() const { return mEntities; }
+  std::span<T> values() { return mValues; }
+
+  // Same interface as ComponentArray::ChunkView, but looks up every entity
+  // through the index
+  class ChunkView {
+  public:
+    bool valid() const { return true; }
+    T& operator[](EntityRef::Id entity) const {
+      return mArray->mValues[mArray->position(entity)];
+    }
+
+  private:
+    friend SparseComponentArray;
+    ChunkView(SparseComponentArray* array) : mArray(array) {}
+
+    SparseComponentArray* mArray;
+  };
+  ChunkView chunkView(size_t index) { return ChunkView(this); }
 
   // Get the number of components of this type
-  size_t size() const { return mData.size(); }
+  size_t size() const { return mValues.size(); }
 
   // Get the number of components allocated
-  size_t capacity() const { return mData.size(); }
+  size_t capacity() const { return mValues.capacity(); }
+
+  // Get the number of index pages allocated, each covering PageSize entities
+  size_t pageCount() const {
+    return std::count_if(mPages.begin(), mPages.end(),
+                         [](auto& page) { return page != nullptr; });
+  }
+
+  StoreStats stats() const {
+    return {
+        .mCount = size(),
+        .mCapacity = capacity(),
+        .mBytes = capacity() * sizeof(T) +
+                  mEntities.capacity() * sizeof(EntityRef::Id) +
+                  pageCount() * sizeof(Page) +
+                  mPages.capacity() * sizeof(mPages[0]),
+        .mSparse = true,
+    };
+  }
+
+private:
+  const static constexpr uint32_t NotPresent =
+      std::numeric_limits<uint32_t>::max();
+
+  // Positions in mValues of PageSize consecutive entities
+  struct Page {
+    Page() { mIndices.fill(NotPresent); }
+    std::array<uint32_t, PageSize> mIndices;
+    // Number of entities in the page with a component
+    uint32_t mCount = 0;
+  };
+
+  Page& getPage(EntityRef::Id entity) {
+    auto index = entity / PageSize;
+    if (mPages.size() <= index)
+      mPages.resize(index + 1);
+    if (mPages[index] == nullptr)
+      mPages[index] = std::make_unique<Page>();
+    return *mPages[index];
+  }
+  uint32_t position(EntityRef::Id entity) const {
+    auto index = entity / PageSize;
+    assert(index < mPages.size() && mPages[index] != nullptr &&
+           mPages[index]->mIndices[entity % PageSize] != NotPresent &&
+           "Entity does not have this component");
+    return mPages[index]->mIndices[entity % PageSize];
+  }
+
+  std::vector<std::unique_ptr<Page>> mPages;
+  std::vector<T> mValues;
+  std::vector<EntityRef::Id> mEntities;
+};
+
+// Components stored densely in chunks while most entities in the allocated
+// chunks have one, and in a sparse set otherwise. Occupancy is measured as the
+// fraction of slots in the chunks that dense storage needs, whichever storage
+// is in use. rebalance() migrates once it crosses a threshold, and the gap
+// between thresholds keeps a store near one from flipping back and forth
+// Starts sparse, as few entities have components before a scene is loaded
+template <typename T, size_t ChunkSize = 1024> class AdaptiveComponentArray {
+public:
+  using ValueType = T;
+  // Not known at compile time, see sparseEntities
+  const static constexpr bool Sparse = false;
+  const static constexpr size_t EntitiesPerChunk = ChunkSize;
+  const char* getTypeName() const { return T::Name; }
+
+  // Migrate to sparse storage below this occupancy, and to dense above the
+  // other
+  const static constexpr float SparseBelow = 0.25f;
+  const static constexpr float DenseAbove = 0.5f;
+
+  // Same interface as ComponentArray::ChunkView, for either storage
+  class ChunkView {
+  public:
+    bool valid() const { return mIsSparse || mDense.valid(); }
+    T& operator[](EntityRef::Id entity) const {
+      return mIsSparse ? mSparse[entity] : mDense[entity];
+    }
+
+  private:
+    friend AdaptiveComponentArray;
+    using DenseView = ComponentArray<T, ChunkSize>::ChunkView;
+    using SparseView = SparseComponentArray<T, ChunkSize>::ChunkView;
+    ChunkView(DenseView dense, SparseView sparse, bool isSparse)
+        : mDense(dense), mSparse(sparse), mIsSparse(isSparse) {}
+
+    DenseView mDense;
+    SparseView mSparse;
+    bool mIsSparse;
+  };
+
+  void add(EntityRef entity, const T& value) {
+    if (mIsSparse)
+      mSparse.add(entity, value);
+    else
+      mDense.add(entity, value);
+  }
+  template <typename F>
+  void addRange(EntityRef::Id begin, size_t count, F&& write) {
+    if (mIsSparse)
+      mSparse.addRange(begin, count, write);
+    else
+      mDense.addRange(begin, count, write);
+  }
+  T& get(EntityRef entity) {
+    return mIsSparse ? mSparse.get(entity) : mDense.get(entity);
+  }
+  void remove(EntityRef entity) {
+    if (mIsSparse)
+      mSparse.remove(entity);
+    else
+      mDense.remove(entity);
+  }
+  ChunkView chunkView(size_t index) {
+    return ChunkView(mDense.chunkView(index), mSparse.chunkView(index),
+                     mIsSparse);
+  }
+
+  // Entities with a component, if currently stored sparsely
+  std::optional<std::span<const EntityRef::Id>> sparseEntities() const {
+    if (!mIsSparse)
+      return std::nullopt;
+    return mSparse.entities();
+  }
+
+  size_t size() const { return mIsSparse ? mSparse.size() : mDense.size(); }
+  size_t capacity() const {
+    return mIsSparse ? mSparse.capacity() : mDense.capacity();
+  }
+  StoreStats stats() const {
+    return mIsSparse ? mSparse.stats() : mDense.stats();
+  }
+
+  // Fraction of the slots in use, were the components stored densely
+  float occupancy() const {
+    auto chunks =
+        mIsSparse ? mSparse.pageCount() : mDense.capacity() / ChunkSize;
+    if (chunks == 0)
+      return 1.0f;
+    return static_cast<float>(size()) / (chunks * ChunkSize);
+  }
+
+  // Migrate to the other storage if occupancy has crossed its threshold.
+  // has(id) tells whether an entity has a component, as dense storage does
+  // not track this itself. Invalidates every reference to a component
+  template <typename F> void rebalance(EntityRef::Id entityCount, F&& has) {
+    auto current = occupancy();
+    if (mIsSparse && current > DenseAbove) {
+      ComponentArray<T, ChunkSize> dense;
+      auto values = mSparse.values();
+      auto entities = mSparse.entities();
+      for (size_t i = 0; i < values.size(); i++) {
+        dense.add(EntityRef(entities[i]), values[i]);
+      }
+      mDense = std::move(dense);
+      mSparse = {};
+      mIsSparse = false;
+    } else if (!mIsSparse && current < SparseBelow) {
+      SparseComponentArray<T, ChunkSize> sparse;
+      for (size_t chunk = 0; chunk * ChunkSize < entityCount; chunk++) {
+        auto view = mDense.chunkView(chunk);
+        if (!view.valid())
+          continue;
+        auto begin = static_cast<EntityRef::Id>(chunk * ChunkSize);
+        auto end = std::min<EntityRef::Id>(begin + ChunkSize, entityCount);
+        for (auto id = begin; id < end; id++) {
+          if (has(id))
+            sparse.add(EntityRef(id), view[id]);
+        }
+      }
+      mSparse = std::move(sparse);
+      mDense = {};
+      mIsSparse = true;
+    }
+  }
 
 private:
-  std::unordered_map<EntityRef, T> mData;
+  ComponentArray<T, ChunkSize> mDense;
+  SparseComponentArray<T, ChunkSize> mSparse;
+  bool mIsSparse = true;
 };
 
 } // namespace selwonk::ecs
@@ -5,34 +5,65 @@
 #include <functional> // For hash
 #include <limits>
 
+// See docs/readme.md
+#ifndef VN_MAXENTITIES
+#define VN_MAXENTITIES (1 << 24)
+#endif
+
 namespace selwonk::ecs {
 // Lightweight reference to an entity managed by the registry. Does nothing
 // without components or systems.
+// IDs are reused once an entity is destroyed. The generation is incremented
+// each time, so that stale references to the old entity can be detected
 class EntityRef {
 public:
   using Id = uint32_t;
+  using Generation = uint32_t;
+  // IDs must be below this. Creating more entities throws
+  const static constexpr size_t MaxEntities = VN_MAXENTITIES;
+  static_assert(MaxEntities < std::numeric_limits<Id>::max(),
+                "VN_MAXENTITIES must leave room for the invalid ID");
 
-  EntityRef() : mId(InvalidId) {}
-  EntityRef(Id id) : mId(id) {}
+  EntityRef() : mId(InvalidId), mGeneration(0) {}
+  explicit EntityRef(Id id, Generation generation = 0)
+      : mId(id), mGeneration(generation) {}
 
   Id id() const {
     assert(valid());
     return mId;
   }
+  Generation generation() const { return mGeneration; }
   bool valid() const { return mId != InvalidId; }
 
   constexpr bool operator==(const EntityRef& rhs) const {
-    return mId == rhs.mId;
+    return mId == rhs.mId && mGeneration == rhs.mGeneration;
   }
 
 private:
   const static constexpr Id InvalidId = std::numeric_limits<Id>::max();
   Id mId;
+  Generation mGeneration;
+};
+
+// Consecutive entities created together, see Registry::createEntities
+struct EntityRange {
+  EntityRef::Id mBegin = 0;
+  EntityRef::Id mEnd = 0;
+
+  size_t size() const { return mEnd - mBegin; }
+  // IDs in a range had never been used before, so are on their first
+  // generation
+  EntityRef operator[](size_t index) const {
+    assert(index < size());
+    return EntityRef(static_cast<EntityRef::Id>(mBegin + index));
+  }
 };
 } // namespace selwonk::ecs
 
 template <> struct std::hash<selwonk::ecs::EntityRef> {
   size_t operator()(const selwonk::ecs::EntityRef& entity) const {
-    return std::hash<selwonk::ecs::EntityRef::Id>{}(entity.id());
+    uint64_t packed = (static_cast<uint64_t>(entity.generation()) << 32) |
+                      entity.id();
+    return std::hash<uint64_t>{}(packed);
   }
 };
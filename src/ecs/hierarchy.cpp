@@ -0,0 +1,44 @@
+#include "hierarchy.hpp"
+
+#include <algorithm>
+
+#include "registry.hpp"
+#include "snapshot.hpp"
+
+namespace selwonk::ecs {
+void Parent::SetParent::apply(Registry& ecs) {
+#ifndef NDEBUG
+  for (auto ancestor = mParent; ecs.hasComponent<Parent>(ancestor);
+       ancestor = ecs.getComponent<Parent>(ancestor).mParent) {
+    assert(ancestor != mTarget && "An entity can not be its own ancestor");
+  }
+#endif
+
+  if (ecs.hasComponent<Parent>(mTarget)) {
+    auto previous = ecs.getComponent<Parent>(mTarget).mParent;
+    if (ecs.hasComponent<Children>(previous)) {
+      auto& siblings = ecs.getComponentMutable<Children>(previous).mChildren;
+      std::erase(siblings, mTarget);
+    }
+  }
+
+  ecs.addComponent(mTarget, Parent{mParent});
+  if (!ecs.hasComponent<Children>(mParent))
+    ecs.addComponent(mParent, Children{});
+  ecs.getComponentMutable<Children>(mParent).mChildren.push_back(mTarget);
+}
+
+void Children::save(SnapshotWriter& out) const {
+  out.write(static_cast<uint32_t>(mChildren.size()));
+  out.write(std::as_bytes(std::span(mChildren)));
+}
+
+Children Children::load(SnapshotReader& in) {
+  Children children;
+  children.mChildren.resize(in.read<uint32_t>());
+  for (auto& child : children.mChildren) {
+    child = in.read<EntityRef>();
+  }
+  return children;
+}
+} // namespace selwonk::ecs
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+#include "component.hpp"
+#include "entity.hpp"
+
+namespace selwonk::ecs {
+class Registry;
+class SnapshotReader;
+class SnapshotWriter;
+
+// Makes an entity's Transform relative to another entity's world transform,
+// see HierarchySystem. The parent must list the entity in its Children
+struct Parent {
+  struct SetParent;
+
+  const static constexpr ComponentType Type = ComponentType::Parent;
+  const static constexpr char* Name = "Parent";
+  using Store = SparseComponentArray<Parent>;
+
+  EntityRef mParent;
+};
+
+// Entities whose Parent is this one
+struct Children {
+  const static constexpr ComponentType Type = ComponentType::Children;
+  const static constexpr char* Name = "Children";
+  using Store = SparseComponentArray<Children>;
+
+  std::vector<EntityRef> mChildren;
+
+  void save(SnapshotWriter& out) const;
+  static Children load(SnapshotReader& in);
+};
+
+// Move an entity under a new parent, keeping both sides of the relationship
+// in sync. Its Transform is kept as is, so becomes relative to the new parent
+struct Parent::SetParent {
+  EntityRef mTarget;
+  EntityRef mParent;
+
+  void apply(Registry& ecs);
+};
+} // namespace selwonk::ecs
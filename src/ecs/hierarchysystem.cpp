@@ -0,0 +1,101 @@
+#include "hierarchysystem.hpp"
+
+namespace selwonk::ecs {
+void HierarchySystem::update(Registry& ecs, Duration dt) {
+  mUpdate++;
+  mDirty.clear();
+  ecs.forEachChanged<Transform>(
+      mVersion, [&](EntityRef entity, const Transform&) {
+        markDirty(ecs, entity);
+      });
+  ecs.forEachChanged<Parent>(
+      mVersion,
+      [&](EntityRef entity, const Parent&) { markDirty(ecs, entity); });
+  mVersion = ecs.changeVersion();
+
+  // A subtree inside another dirty one will be visited anyway
+  mRoots.clear();
+  for (auto entity : mDirty) {
+    if (!hasDirtyAncestor(ecs, entity))
+      mRoots.push_back(entity);
+  }
+
+  ecs.forEachChunk({0, mRoots.size()}, /*grainSize=*/1,
+                   [&](ThreadPool::Range range) {
+                     Subtree scratch;
+                     for (size_t i = range.begin; i < range.end; i++) {
+                       propagate(ecs, mRoots[i], scratch);
+                     }
+                   });
+}
+
+void HierarchySystem::markDirty(Registry& ecs, EntityRef entity) {
+  // Same requirement as children in propagate, which reads both
+  if (!ecs.hasComponent<Transform>(entity) ||
+      !ecs.hasComponent<WorldTransform>(entity))
+    return;
+  if (mDirtyUpdate.size() <= entity.id())
+    mDirtyUpdate.resize(entity.id() + 1);
+  if (mDirtyUpdate[entity.id()] == mUpdate)
+    return;
+  mDirtyUpdate[entity.id()] = mUpdate;
+  mDirty.push_back(entity);
+}
+
+bool HierarchySystem::hasDirtyAncestor(Registry& ecs, EntityRef entity) {
+  while (ecs.hasComponent<Parent>(entity)) {
+    entity = ecs.getComponent<Parent>(entity).mParent;
+    if (!ecs.alive(entity))
+      return false;
+    if (entity.id() < mDirtyUpdate.size() &&
+        mDirtyUpdate[entity.id()] == mUpdate)
+      return true;
+  }
+  return false;
+}
+
+void HierarchySystem::propagate(Registry& ecs, EntityRef root,
+                                Subtree& scratch) {
+  scratch.mNodes.clear();
+  scratch.mParents.clear();
+  scratch.mLocal.clear();
+
+  // Gather the subtree breadth first, so every parent comes before its
+  // children
+  scratch.mNodes.push_back(root);
+  scratch.mParents.push_back(NoParent);
+  for (size_t i = 0; i < scratch.mNodes.size(); i++) {
+    auto node = scratch.mNodes[i];
+    scratch.mLocal.push(ecs.getComponent<Transform>(node));
+    if (!ecs.hasComponent<Children>(node))
+      continue;
+    for (auto child : ecs.getComponent<Children>(node).mChildren) {
+      if (ecs.hasComponent<Transform>(child) &&
+          ecs.hasComponent<WorldTransform>(child)) {
+        scratch.mNodes.push_back(child);
+        scratch.mParents.push_back(static_cast<uint32_t>(i));
+      }
+    }
+  }
+
+  // Convert every local transform at once, then combine in order
+  scratch.mMatrices.resize(scratch.mNodes.size());
+  scratch.mLocal.toMatrices(scratch.mMatrices);
+
+  // The root's parent is not dirty, so its world transform is up to date and
+  // not being written by another job
+  glm::mat4 rootParent(1.0f);
+  if (ecs.hasComponent<Parent>(root)) {
+    auto parent = ecs.getComponent<Parent>(root).mParent;
+    if (ecs.hasComponent<WorldTransform>(parent))
+      rootParent = ecs.getComponent<WorldTransform>(parent).mMatrix;
+  }
+  for (size_t i = 0; i < scratch.mNodes.size(); i++) {
+    auto parent = scratch.mParents[i];
+    auto& world = scratch.mMatrices[i];
+    world = (parent == NoParent ? rootParent : scratch.mMatrices[parent]) *
+            world;
+    ecs.getComponentMutable<WorldTransform>(scratch.mNodes[i]).mMatrix = world;
+  }
+}
+} // namespace selwonk::ecs
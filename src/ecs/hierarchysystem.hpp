@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "hierarchy.hpp"
+#include "registry.hpp"
+#include "system.hpp"
+#include "transform.hpp"
+#include "transformstreams.hpp"
+
+namespace selwonk::ecs {
+// Keeps WorldTransform up to date for entities with a Transform, combining it
+// with the world transforms of any parents
+// Only subtrees under an entity whose Transform or Parent changed are
+// revisited. Each is walked breadth first so that parents are always ready
+// before their children, and independent subtrees are processed in parallel
+class HierarchySystem
+    : public TypedSystem<Reads<Transform, Parent, Children>,
+                         Writes<WorldTransform>> {
+public:
+  void update(Registry& ecs, Duration dt) override;
+  std::string_view name() const noexcept override { return "Hierarchy"; }
+
+private:
+  // Per-job scratch space for walking a subtree
+  struct Subtree {
+    std::vector<EntityRef> mNodes;
+    // Index in mNodes of each node's parent, or NoParent for the root
+    std::vector<uint32_t> mParents;
+    TransformStreams mLocal;
+    std::vector<glm::mat4> mMatrices;
+  };
+  const static constexpr uint32_t NoParent =
+      std::numeric_limits<uint32_t>::max();
+
+  void markDirty(Registry& ecs, EntityRef entity);
+  bool hasDirtyAncestor(Registry& ecs, EntityRef entity);
+  // Recalculate the world transforms of an entity and all of its descendants
+  void propagate(Registry& ecs, EntityRef root, Subtree& scratch);
+
+  Registry::ChangeVersion mVersion = 0;
+  // Entities changed since the last update
+  std::vector<EntityRef> mDirty;
+  // Dirty entities with no dirty ancestors
+  std::vector<EntityRef> mRoots;
+  // The update in which each entity was last marked dirty, indexed by ID
+  std::vector<uint32_t> mDirtyUpdate;
+  uint32_t mUpdate = 0;
+};
+} // namespace selwonk::ecs
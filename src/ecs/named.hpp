@@ -8,7 +8,8 @@ namespace selwonk::ecs {
 struct Named {
   const static constexpr ComponentType Type = ComponentType::Named;
   const static constexpr char* Name = "Named";
-  using Store = ComponentArray<Named>;
+  // Usually only a few entities are named, but a loaded scene may name most
+  using Store = AdaptiveComponentArray<Named>;
 
   // Fit in exactly 64 bytes
   core::FixedString<char, 63> mName;
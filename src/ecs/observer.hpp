@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "component.hpp"
+#include "entity.hpp"
+
+namespace selwonk::ecs {
+class Registry;
+
+enum class ObserverEvent : uint8_t {
+  Add,
+  Remove,
+  Change,
+  Max,
+};
+
+// Events that can be observed with Registry::observe. Observers are called at
+// the next barrier with every entity the event happened to since the last
+template <typename T> struct OnAdd {
+  using Component = T;
+  const static constexpr ObserverEvent Event = ObserverEvent::Add;
+};
+// Dispatched before the entities are destroyed, so their components can still
+// be read. References are stale once the observer returns
+template <typename T> struct OnRemove {
+  using Component = T;
+  const static constexpr ObserverEvent Event = ObserverEvent::Remove;
+};
+// Anything that would be visited by forEachChanged, including adds
+template <typename T> struct OnChange {
+  using Component = T;
+  const static constexpr ObserverEvent Event = ObserverEvent::Change;
+};
+
+// Observer callbacks, and the add and remove events waiting to be dispatched
+// to them, by event and component type. Changes are not buffered, as the
+// registry already stamps every change with a version
+class ObserverList {
+public:
+  using Callback = std::function<void(Registry&, std::span<const EntityRef>)>;
+
+  void add(ObserverEvent event, ComponentType type, Callback callback) {
+    mObserved[index(event)].setComponentPresent(type, true);
+    slot(event, type).mCallbacks.emplace_back(std::move(callback));
+  }
+
+  // Is anything observing the event? Nothing is recorded if not
+  bool observed(ObserverEvent event, ComponentType type) const {
+    return mObserved[index(event)].hasComponent(type);
+  }
+  bool anyObserved(ObserverEvent event) const {
+    return mObserved[index(event)] != ComponentMask();
+  }
+
+  void record(ObserverEvent event, ComponentType type, EntityRef entity) {
+    if (observed(event, type))
+      slot(event, type).mPending.push_back(entity);
+  }
+
+  // Take the events waiting for dispatch, leaving an empty buffer to record
+  // into. Pass the events back to `recycle` once done to reuse their storage
+  std::vector<EntityRef> takePending(ObserverEvent event, ComponentType type) {
+    auto& s = slot(event, type);
+    return std::exchange(s.mPending, std::move(s.mSpare));
+  }
+  void recycle(ObserverEvent event, ComponentType type,
+               std::vector<EntityRef>&& events) {
+    events.clear();
+    slot(event, type).mSpare = std::move(events);
+  }
+
+  void dispatch(Registry& ecs, ObserverEvent event, ComponentType type,
+                std::span<const EntityRef> entities) {
+    if (entities.empty())
+      return;
+    for (auto& callback : slot(event, type).mCallbacks) {
+      callback(ecs, entities);
+    }
+  }
+
+private:
+  const static constexpr size_t ComponentTypeCount =
+      static_cast<size_t>(ComponentType::Max);
+  const static constexpr size_t EventCount =
+      static_cast<size_t>(ObserverEvent::Max);
+
+  struct Slot {
+    std::vector<Callback> mCallbacks;
+    std::vector<EntityRef> mPending;
+    // Storage of the last batch dispatched, swapped in to avoid reallocating
+    std::vector<EntityRef> mSpare;
+  };
+
+  static size_t index(ObserverEvent event) {
+    return static_cast<size_t>(event);
+  }
+  Slot& slot(ObserverEvent event, ComponentType type) {
+    return mSlots[index(event) * ComponentTypeCount +
+                  static_cast<size_t>(type)];
+  }
+
+  // Component types with at least one observer, by event
+  std::array<ComponentMask, EventCount> mObserved = {};
+  std::array<Slot, EventCount * ComponentTypeCount> mSlots;
+};
+} // namespace selwonk::ecs
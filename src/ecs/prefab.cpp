@@ -0,0 +1,81 @@
+#include "prefab.hpp"
+
+#include <cassert>
+
+#include "registry.hpp"
+
+namespace selwonk::ecs {
+void Prefab::Instantiate::apply(Registry& ecs) {
+  mPrefab->instantiate(ecs, mTransforms);
+}
+
+uint32_t Prefab::addNode(const Node& node) {
+  assert((node.mParent == NoParent || node.mParent < mNodes.size()) &&
+         "Nodes must be added after their parent");
+  auto index = static_cast<uint32_t>(mNodes.size());
+  mNodes.push_back(node);
+  mChildren.emplace_back();
+  if (node.mParent != NoParent)
+    mChildren[node.mParent].push_back(index);
+  return index;
+}
+
+EntityRange Prefab::instantiate(Registry& ecs,
+                                std::span<const Transform> transforms) const {
+  auto copies = transforms.size();
+  auto entities = ecs.createEntities(mNodes.size() * copies);
+  // Entities of every copy of a node
+  auto nodeEntities = [&](size_t node) {
+    auto begin = static_cast<EntityRef::Id>(entities.mBegin + node * copies);
+    return EntityRange{
+        .mBegin = begin,
+        .mEnd = static_cast<EntityRef::Id>(begin + copies),
+    };
+  };
+
+  ecs.addComponents(entities, WorldTransform{});
+
+  std::vector<Transform> roots(copies);
+  std::vector<Parent> parents(copies);
+  std::vector<Children> children(copies);
+  for (size_t n = 0; n < mNodes.size(); n++) {
+    auto& node = mNodes[n];
+    auto range = nodeEntities(n);
+
+    if (node.mParent == NoParent) {
+      for (size_t i = 0; i < copies; i++) {
+        roots[i] = transforms[i].apply(node.mLocal);
+      }
+      ecs.addComponents<Transform>(range, roots);
+    } else {
+      ecs.addComponents(range, node.mLocal);
+      auto parentRange = nodeEntities(node.mParent);
+      for (size_t i = 0; i < copies; i++) {
+        parents[i].mParent = parentRange[i];
+      }
+      ecs.addComponents<Parent>(range, parents);
+    }
+
+    if (!mChildren[n].empty()) {
+      for (size_t i = 0; i < copies; i++) {
+        children[i].mChildren.clear();
+        for (auto child : mChildren[n]) {
+          children[i].mChildren.push_back(nodeEntities(child)[i]);
+        }
+      }
+      ecs.addComponents<Children>(range, children);
+    }
+
+    if (node.mRenderable.has_value())
+      ecs.addComponents(range, *node.mRenderable);
+    if (node.mNamed.has_value())
+      ecs.addComponents(range, *node.mNamed);
+    if (!node.mEnabled) {
+      for (size_t i = 0; i < copies; i++) {
+        ecs.setEnabled(range[i], false);
+      }
+    }
+  }
+  return entities;
+}
+} // namespace selwonk::ecs
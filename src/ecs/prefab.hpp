@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "entity.hpp"
+#include "named.hpp"
+#include "renderable.hpp"
+#include "transform.hpp"
+
+namespace selwonk::ecs {
+class Registry;
+
+// Flattened tree of entities that can be created many times over, such as a
+// scene loaded from a glTF. Nodes are stored parents first, so instantiating
+// is a loop over the nodes that adds each component to every copy at once,
+// rather than a walk of the tree per copy
+// Immutable once built, so may be shared between threads
+class Prefab {
+public:
+  const static constexpr uint32_t NoParent =
+      std::numeric_limits<uint32_t>::max();
+
+  struct Node {
+    // Index of the parent node, or NoParent for a root
+    uint32_t mParent = NoParent;
+    // Relative to the parent, or for roots the transform given to instantiate
+    Transform mLocal;
+    std::optional<Renderable> mRenderable;
+    std::optional<Named> mNamed;
+    bool mEnabled = true;
+  };
+
+  // Instantiate a prefab at the next barrier. May be queued from any system,
+  // but there is no way to know the entities that were created
+  struct Instantiate {
+    std::shared_ptr<const Prefab> mPrefab;
+    std::vector<Transform> mTransforms;
+
+    void apply(Registry& ecs);
+  };
+
+  // Add a node, returning its index. The parent must already have been added
+  uint32_t addNode(const Node& node);
+
+  std::span<const Node> nodes() const { return mNodes; }
+
+  // Create a copy of every node at each transform. Returns the entities
+  // created, where node n of copy i is at n * transforms.size() + i
+  EntityRange instantiate(Registry& ecs,
+                          std::span<const Transform> transforms) const;
+
+private:
+  std::vector<Node> mNodes;
+  // Indices of each node's children
+  std::vector<std::vector<uint32_t>> mChildren;
+};
+} // namespace selwonk::ecs
@@ -0,0 +1,37 @@
+#include "query.hpp"
+
+#include <cassert>
+
+namespace selwonk::ecs {
+void Query::update(EntityRef::Id entity, ComponentMask before,
+                   ComponentMask after) {
+  bool matched = before.matches(mMask);
+  bool matches = after.matches(mMask);
+  if (matches && !matched)
+    add(entity);
+  else if (matched && !matches)
+    remove(entity);
+}
+
+void Query::add(EntityRef::Id entity) {
+  if (mPositions.size() <= entity)
+    mPositions.resize(entity + 1, NotPresent);
+  assert(mPositions[entity] == NotPresent && "Entity is already in the query");
+
+  mPositions[entity] = static_cast<uint32_t>(mEntities.size());
+  mEntities.push_back(entity);
+}
+
+void Query::remove(EntityRef::Id entity) {
+  assert(entity < mPositions.size() && mPositions[entity] != NotPresent &&
+         "Entity is not in the query");
+
+  // Swap with the last entity to avoid shifting everything after it
+  auto position = mPositions[entity];
+  auto last = mEntities.back();
+  mEntities[position] = last;
+  mPositions[last] = position;
+  mEntities.pop_back();
+  mPositions[entity] = NotPresent;
+}
+} // namespace selwonk::ecs
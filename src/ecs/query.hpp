@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include "component.hpp"
+#include "entity.hpp"
+
+namespace selwonk::ecs {
+// Cached list of the entities whose component mask matches a search mask.
+// Kept up to date by the registry whenever a mask changes, so that iterating
+// costs time proportional to the number of matches rather than the number of
+// entities ever created
+// Entities are not kept in any particular order
+class Query {
+public:
+  Query(ComponentMask mask) : mMask(mask) {}
+
+  const ComponentMask& mask() const { return mMask; }
+  std::span<const EntityRef::Id> entities() const { return mEntities; }
+
+  // Called when an entity's mask changes
+  void update(EntityRef::Id entity, ComponentMask before, ComponentMask after);
+
+private:
+  const static constexpr uint32_t NotPresent =
+      std::numeric_limits<uint32_t>::max();
+
+  void add(EntityRef::Id entity);
+  void remove(EntityRef::Id entity);
+
+  ComponentMask mMask;
+  std::vector<EntityRef::Id> mEntities;
+  // Index of each entity in mEntities, or NotPresent
+  std::vector<uint32_t> mPositions;
+};
+} // namespace selwonk::ecs
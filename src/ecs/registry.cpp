@@ -1,25 +1,391 @@
 #include "registry.hpp"
 
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include <fmt/format.h>
+
 #include "../core/profiler.hpp"
 #include "applycommandssystem.hpp"
 
 namespace selwonk::ecs {
+namespace {
+// Command buffer last used by this thread, and the registry it belongs to
+struct CachedCommandBuffer {
+  size_t mRegistry = std::numeric_limits<size_t>::max();
+  Registry::CommandBuffer* mBuffer = nullptr;
+};
+thread_local CachedCommandBuffer tCommandBuffer;
+
+// Mask of a newly created entity, alive and enabled without any components
+ComponentMask newEntityMask() {
+  ComponentMask mask;
+  mask.setFlag(EntityFlag::Alive, true);
+  mask.setFlag(EntityFlag::Enabled, true);
+  return mask;
+}
+
+#ifndef NDEBUG
+// Access declared by the system running on this thread, if any
+thread_local const SystemAccess* tSystemAccess = nullptr;
+#endif
+} // namespace
+
+void DestroyEntity::apply(Registry& ecs) { ecs.destroyEntity(mTarget); }
+
 ComponentMask Registry::getComponentMask(EntityRef entity) {
-  if (entity.id() >= mComponentMasks.size())
+  if (!entity.valid() || entity.id() >= mComponentMasks.size() ||
+      mGenerations[entity.id()] != entity.generation())
     return ComponentMask::null();
   return mComponentMasks[entity.id()];
 }
 
 EntityRef Registry::createEntity() {
-  EntityRef::Id id = mNextEntityId;
-  mComponentMasks.resize(
-      std::max(id + 1, (EntityRef::Id)mComponentMasks.size()));
-  mNextEntityId++;
+  EntityRef::Id id;
+  if (!mFreeIds.empty()) {
+    id = mFreeIds.back();
+    mFreeIds.pop_back();
+  } else {
+    reserveIds(1);
+    id = mNextEntityId++;
+    growEntities();
+  }
+
+  setComponentMask(id, newEntityMask());
+  return EntityRef(id, mGenerations[id]);
+}
+
+EntityRange Registry::createEntities(size_t count) {
+  reserveIds(count);
+  EntityRange range = {
+      .mBegin = mNextEntityId,
+      .mEnd = static_cast<EntityRef::Id>(mNextEntityId + count),
+  };
+  mNextEntityId = range.mEnd;
+  growEntities();
+
+  for (auto id = range.mBegin; id < range.mEnd; id++) {
+    setComponentMask(id, newEntityMask());
+  }
+  return range;
+}
+
+void Registry::reserveIds(size_t count) {
+  if (count > EntityRef::MaxEntities - mNextEntityId)
+    throw std::runtime_error(
+        fmt::format("Can not create {} more entities, the limit is {}. Raise "
+                    "VN_MAXENTITIES to allow more",
+                    count, EntityRef::MaxEntities));
+}
+
+void Registry::growEntities() {
+  mComponentMasks.resize(mNextEntityId);
+  mGenerations.resize(mNextEntityId);
+  for (size_t type = 0; type < ComponentTypeCount; type++) {
+    mChangeVersions[type].resize(mNextEntityId);
+    mChunkChangeVersions[type].resize((mNextEntityId + ChunkSize - 1) /
+                                      ChunkSize);
+  }
+}
+
+void Registry::destroyEntity(EntityRef entity) {
+  checkAlive(entity);
+  auto mask = mComponentMasks[entity.id()];
+  bool observed = false;
+  for (size_t i = 0; i < ComponentTypeCount; i++) {
+    auto type = static_cast<ComponentType>(i);
+    observed |= mask.hasComponent(type) &&
+                mObservers.observed(ObserverEvent::Remove, type);
+  }
+  if (!observed) {
+    removeEntity(entity);
+    return;
+  }
+
+  // OnRemove observers may read the components being removed, so the entity
+  // outlives them
+  if (!mInBarrier) {
+    for (size_t i = 0; i < ComponentTypeCount; i++) {
+      auto type = static_cast<ComponentType>(i);
+      if (mask.hasComponent(type))
+        mObservers.dispatch(*this, ObserverEvent::Remove, type, {&entity, 1});
+    }
+    removeEntity(entity);
+    return;
+  }
+  for (size_t i = 0; i < ComponentTypeCount; i++) {
+    auto type = static_cast<ComponentType>(i);
+    if (mask.hasComponent(type))
+      mObservers.record(ObserverEvent::Remove, type, entity);
+  }
+  mPendingDestroy.push_back(entity);
+}
+
+void Registry::removeEntity(EntityRef entity) {
+  auto id = entity.id();
+  auto mask = mComponentMasks[id];
+  // Archetype storage removes the row once the entity is no longer alive
+  if (mStorage == StorageMode::Arrays) {
+    std::apply(
+        [&](auto&... arrays) {
+          ((mask.hasComponent(std::decay_t<decltype(arrays)>::ValueType::Type)
+                ? arrays.remove(entity)
+                : void()),
+           ...);
+        },
+        mComponentArrays);
+  }
 
-  mComponentMasks[id].setFlag(EntityFlag::Alive, true);
-  mComponentMasks[id].setFlag(EntityFlag::Enabled, true);
+  setComponentMask(id, ComponentMask::null());
+  // Invalidate existing references before the ID can be reused
+  mGenerations[id]++;
+  mFreeIds.push_back(id);
+}
+
+void Registry::setComponentMask(EntityRef::Id entity, ComponentMask mask) {
+  auto before = mComponentMasks[entity];
+  mComponentMasks[entity] = mask;
+  if (mStorage == StorageMode::Archetypes) {
+    // Tables are matched on each iteration, so no queries are kept
+    mArchetypes.setMask(entity, mask);
+    return;
+  }
+  for (auto& query : mQueries) {
+    query->update(entity, before, mask);
+  }
+}
+
+void Registry::setComponentPresent(ComponentType type,
+                                   EntityRef::Id entity) {
+  stampChanged(type, entity);
+  mObservers.record(ObserverEvent::Add, type,
+                    EntityRef(entity, mGenerations[entity]));
+  auto mask = mComponentMasks[entity];
+  mask.setComponentPresent(type, true);
+  setComponentMask(entity, mask);
+}
+
+void Registry::dispatchObservers() {
+  if (!mObservers.anyObserved(ObserverEvent::Add) &&
+      !mObservers.anyObserved(ObserverEvent::Remove) &&
+      !mObservers.anyObserved(ObserverEvent::Change)) {
+    assert(mPendingDestroy.empty());
+    return;
+  }
+  core::Profiler::get().startSection("Observers");
+
+  // Take every event before calling any observer, so that events caused by
+  // observers are consistently left for the next barrier. Changes they make
+  // are stamped with a later version for the same reason
+  auto since = mDispatchedVersion;
+  mDispatchedVersion = ++mChangeVersion;
+  std::array<std::vector<EntityRef>, ComponentTypeCount> removed;
+  std::array<std::vector<EntityRef>, ComponentTypeCount> added;
+  for (size_t i = 0; i < ComponentTypeCount; i++) {
+    auto type = static_cast<ComponentType>(i);
+    removed[i] = mObservers.takePending(ObserverEvent::Remove, type);
+    added[i] = mObservers.takePending(ObserverEvent::Add, type);
+    // An entity may be destroyed by several threads' commands, or a component
+    // added several times, before it is dispatched. Only report each once
+    std::ranges::sort(removed[i], {}, &EntityRef::id);
+    removed[i].erase(std::ranges::unique(removed[i]).begin(),
+                     removed[i].end());
+    std::ranges::sort(added[i], {}, &EntityRef::id);
+    added[i].erase(std::ranges::unique(added[i]).begin(), added[i].end());
+  }
+  std::vector<EntityRef> destroyed;
+  std::swap(destroyed, mPendingDestroy);
+
+  std::array<std::vector<EntityRef>, ComponentTypeCount> changed;
+  for (size_t i = 0; i < ComponentTypeCount; i++) {
+    auto type = static_cast<ComponentType>(i);
+    if (!mObservers.observed(ObserverEvent::Change, type))
+      continue;
+    // Same as forEachChanged, but for all entities with the component
+    size_t chunks = (mNextEntityId + ChunkSize - 1) / ChunkSize;
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+      if (mChunkChangeVersions[i][chunk] < since)
+        continue;
+      auto begin = static_cast<EntityRef::Id>(chunk * ChunkSize);
+      auto end = std::min<EntityRef::Id>(begin + ChunkSize, mNextEntityId);
+      for (auto id = begin; id < end; id++) {
+        if (mChangeVersions[i][id] >= since &&
+            mComponentMasks[id].hasComponent(type))
+          changed[i].emplace_back(id, mGenerations[id]);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < ComponentTypeCount; i++) {
+    auto type = static_cast<ComponentType>(i);
+    mObservers.dispatch(*this, ObserverEvent::Remove, type, removed[i]);
+    mObservers.recycle(ObserverEvent::Remove, type, std::move(removed[i]));
+  }
 
-  return EntityRef(id);
+  // Removes have been seen, so the entities can go. Adds and changes are only
+  // reported for components that are still there
+  for (auto entity : destroyed) {
+    if (alive(entity))
+      removeEntity(entity);
+  }
+  for (size_t i = 0; i < ComponentTypeCount; i++) {
+    auto type = static_cast<ComponentType>(i);
+    auto gone = [&](EntityRef entity) {
+      return !alive(entity) || !getComponentMask(entity).hasComponent(type);
+    };
+    std::erase_if(added[i], gone);
+    std::erase_if(changed[i], gone);
+  }
+
+  for (size_t i = 0; i < ComponentTypeCount; i++) {
+    auto type = static_cast<ComponentType>(i);
+    mObservers.dispatch(*this, ObserverEvent::Add, type, added[i]);
+    mObservers.recycle(ObserverEvent::Add, type, std::move(added[i]));
+  }
+  for (size_t i = 0; i < ComponentTypeCount; i++) {
+    mObservers.dispatch(*this, ObserverEvent::Change,
+                        static_cast<ComponentType>(i), changed[i]);
+  }
+}
+
+void Registry::rebalanceStores() {
+  if (mStorage != StorageMode::Arrays)
+    return;
+  std::apply(
+      [&](auto&... stores) {
+        auto rebalance = [&](auto& store) {
+          using T = std::decay_t<decltype(store)>::ValueType;
+          auto has = [&](EntityRef::Id id) {
+            return mComponentMasks[id].hasComponent(T::Type);
+          };
+          if constexpr (requires { store.rebalance(mNextEntityId, has); })
+            store.rebalance(mNextEntityId, has);
+        };
+        (rebalance(stores), ...);
+      },
+      mComponentArrays);
+}
+
+void Registry::stampChanged(ComponentType type, EntityRef::Id entity) {
+  auto index = static_cast<size_t>(type);
+  mChangeVersions[index][entity] = mChangeVersion;
+  // Entities in the same chunk may be changed in parallel. They all store the
+  // same version, so the order doesn't matter
+  std::atomic_ref(mChunkChangeVersions[index][entity / ChunkSize])
+      .store(mChangeVersion, std::memory_order_relaxed);
+}
+
+void Registry::tooManyQueries(size_t id) {
+  fmt::println(stderr,
+               "Query {} exceeds the limit of {} distinct queries. Raise "
+               "Registry::MaxQueries",
+               id, MaxQueries);
+  std::abort();
+}
+
+Query& Registry::createQuery(
+    size_t id, ComponentMask mask,
+    std::optional<std::span<const EntityRef::Id>> candidates) {
+  std::lock_guard lock(mQueriesMtx);
+  // Another thread may have beaten us to it
+  if (auto* query = mQuerySlots[id].load(std::memory_order_relaxed))
+    return *query;
+
+  auto existing =
+      std::find_if(mQueries.begin(), mQueries.end(),
+                   [&](auto& query) { return query->mask() == mask; });
+  Query* query;
+  if (existing != mQueries.end()) {
+    query = existing->get();
+  } else {
+    query = mQueries.emplace_back(std::make_unique<Query>(mask)).get();
+    auto check = [&](EntityRef::Id entity) {
+      query->update(entity, ComponentMask::null(), mComponentMasks[entity]);
+    };
+    if (candidates) {
+      for (auto entity : *candidates) {
+        check(entity);
+      }
+    } else {
+      for (EntityRef::Id entity = 0; entity < mNextEntityId; entity++) {
+        check(entity);
+      }
+    }
+  }
+
+  mQuerySlots[id].store(query, std::memory_order_release);
+  return *query;
+}
+
+void Registry::buildSchedule() {
+  mScheduleDirty = false;
+  mPhases.clear();
+  mSchedule = std::vector<ScheduledSystem>(mSystems.size() -
+                                           mCommandBarrierCount);
+
+  size_t next = 0;
+  Phase phase = {.mBegin = 0, .mBarrier = nullptr, .mBlocksCommands = false};
+  for (auto& system : mSystems) {
+    if (dynamic_cast<ApplyCommandsSystem*>(system.get()) != nullptr) {
+      phase.mEnd = next;
+      phase.mBarrier = system.get();
+      mPhases.push_back(phase);
+      phase = {.mBegin = next, .mBarrier = nullptr, .mBlocksCommands = false};
+      continue;
+    }
+
+    auto& scheduled = mSchedule[next];
+    scheduled.mSystem = system.get();
+    scheduled.mAccess = system->access();
+    phase.mBlocksCommands |= system->blocksBarriers() != std::nullopt;
+
+    // Conflicting systems keep the order they were added in. Main thread
+    // systems are already run in order, so need no edge between them
+    for (size_t i = phase.mBegin; i < next; i++) {
+      auto& earlier = mSchedule[i];
+      if (earlier.mAccess.mMainThread && scheduled.mAccess.mMainThread)
+        continue;
+      if (earlier.mAccess.conflicts(scheduled.mAccess)) {
+        earlier.mSuccessors.push_back(next);
+        scheduled.mPredecessors++;
+      }
+    }
+    next++;
+  }
+  phase.mEnd = next;
+  mPhases.push_back(phase);
+}
+
+Registry::CommandBuffer& Registry::localCommandBuffer() {
+  if (tCommandBuffer.mRegistry == mRegistryId)
+    return *tCommandBuffer.mBuffer;
+
+  // A thread only gets here once per registry, or when switching between
+  // registries
+  std::lock_guard lock(mCommandsMtx);
+  auto thread = std::this_thread::get_id();
+  auto it = std::find(mCommandThreads.begin(), mCommandThreads.end(), thread);
+  CommandBuffer* buffer;
+  if (it != mCommandThreads.end()) {
+    buffer = mCommandBuffers[it - mCommandThreads.begin()].get();
+  } else {
+    mCommandBuffers.emplace_back(std::make_unique<CommandBuffer>());
+    mCommandThreads.push_back(thread);
+    buffer = mCommandBuffers.back().get();
+  }
+  tCommandBuffer = {.mRegistry = mRegistryId, .mBuffer = buffer};
+  return *buffer;
+}
+
+size_t Registry::pendingCommands() const {
+  size_t count = 0;
+  for (auto& buffer : mCommandBuffers) {
+    count += buffer->size();
+  }
+  return count;
 }
 
 void Registry::update(Duration dt) {
@@ -28,22 +394,44 @@ void Registry::update(Duration dt) {
 #ifndef NDEBUG
   debug_commandsBlocked = false;
 #endif
-
-  for (auto& system : mSystems) {
-    core::Profiler::get().startSection(system->name());
+  if (mScheduleDirty)
+    buildSchedule();
 
 #ifndef NDEBUG
-    debug_commandsBlocked |= system->blocksBarriers() != std::nullopt;
-    debug_barrierActive =
-        dynamic_cast<ApplyCommandsSystem*>(system.get()) != nullptr;
+  // Commands queued by observers at the last barrier, which wait for the next
+  // update
+  size_t carriedCommands = 0;
 #endif
+  for (auto& phase : mPhases) {
+    mChangeVersion++;
+    runPhase(phase, dt);
 
-    system->update(*this, dt);
+    if (phase.mBarrier != nullptr) {
+      core::Profiler::get().startSection(phase.mBarrier->name());
+      mInBarrier = true;
+#ifndef NDEBUG
+      debug_barrierActive = true;
+      auto access = SystemAccess::exclusive();
+      auto* previous = debug_swapAccess(&access);
+#endif
+      phase.mBarrier->update(*this, dt);
+#ifndef NDEBUG
+      // Observers may queue commands for the next barrier
+      debug_barrierActive = false;
+#endif
+      dispatchObservers();
+      mInBarrier = false;
+#ifndef NDEBUG
+      debug_swapAccess(previous);
+      carriedCommands = pendingCommands();
+#endif
+    }
   }
 
-  assert(mQueuedCommands.empty() &&
+  assert(pendingCommands() == carriedCommands &&
          "The last command barrier must appear after the last system that "
          "writes commands");
+  rebalanceStores();
 #ifndef NDEBUG
   // Allow writes outside of updates, for exceptional cases where a system would
   // be overkill such as updating the camera's target after a resize
@@ -51,4 +439,129 @@ void Registry::update(Duration dt) {
 #endif
 }
 
+void Registry::runPhase(const Phase& phase, Duration dt) {
+#ifndef NDEBUG
+  debug_commandsBlocked |= phase.mBlocksCommands;
+#endif
+  auto& profiler = core::Profiler::get();
+  ThreadPool* pool = ThreadPool::current();
+  if (pool == nullptr) {
+    // Nowhere to run in parallel, edges only point forwards so running in
+    // order satisfies them
+    for (size_t i = phase.mBegin; i < phase.mEnd; i++) {
+      profiler.startSection(mSchedule[i].mSystem->name());
+      runSystem(nullptr, i, dt);
+    }
+    return;
+  }
+
+  bool anyWorkers = false;
+  mPhasePending.store(phase.mEnd - phase.mBegin, std::memory_order_relaxed);
+  for (size_t i = phase.mBegin; i < phase.mEnd; i++) {
+    auto& system = mSchedule[i];
+    system.mRemaining.store(system.mPredecessors, std::memory_order_relaxed);
+    anyWorkers |= !system.mAccess.mMainThread;
+  }
+  for (size_t i = phase.mBegin; i < phase.mEnd; i++) {
+    auto& system = mSchedule[i];
+    if (!system.mAccess.mMainThread && system.mPredecessors == 0)
+      spawnSystem(*pool, i, dt);
+  }
+
+  // Main thread systems run in order as they become ready, other systems are
+  // run by the pool in the meantime
+  for (size_t i = phase.mBegin; i < phase.mEnd; i++) {
+    auto& system = mSchedule[i];
+    if (!system.mAccess.mMainThread)
+      continue;
+    pool->helpUntilZero(system.mRemaining);
+    profiler.startSection(system.mSystem->name());
+    runSystem(pool, i, dt);
+  }
+
+  // Systems on other threads can't be timed individually, so are timed as a
+  // group from when the main thread runs out of its own
+  if (anyWorkers)
+    profiler.startSection("Parallel systems");
+  pool->helpUntilZero(mPhasePending);
+}
+
+void Registry::spawnSystem(ThreadPool& pool, size_t index, Duration dt) {
+  pool.addJob([this, &pool, index, dt] { runSystem(&pool, index, dt); });
+}
+
+void Registry::runSystem(ThreadPool* pool, size_t index, Duration dt) {
+  auto& system = mSchedule[index];
+#ifndef NDEBUG
+  debug_beginAccess(system.mAccess);
+  // Restored afterwards rather than cleared, as this may be another system's
+  // job that the calling system ran while waiting on the pool
+  auto* previous = debug_swapAccess(&system.mAccess);
+#endif
+  system.mSystem->update(*this, dt);
+#ifndef NDEBUG
+  debug_swapAccess(previous);
+  debug_endAccess(system.mAccess);
+#endif
+
+  if (pool == nullptr)
+    return;
+  for (size_t next : system.mSuccessors) {
+    auto& successor = mSchedule[next];
+    if (successor.mAccess.mMainThread) {
+      // The main thread is waiting on the counter
+      pool->countDown(successor.mRemaining);
+    } else if (successor.mRemaining.fetch_sub(
+                   1, std::memory_order_acq_rel) == 1) {
+      spawnSystem(*pool, next, dt);
+    }
+  }
+  pool->countDown(mPhasePending);
+}
+
+#ifndef NDEBUG
+bool Registry::debug_mayRead(ComponentType type) {
+  // Code outside of systems is trusted to not race with them
+  if (tSystemAccess == nullptr)
+    return true;
+  return tSystemAccess->mReads.hasComponent(type) ||
+         tSystemAccess->mWrites.hasComponent(type);
+}
+
+bool Registry::debug_mayWrite(ComponentType type) {
+  return tSystemAccess != nullptr && tSystemAccess->mWrites.hasComponent(type);
+}
+
+const SystemAccess* Registry::debug_currentAccess() { return tSystemAccess; }
+
+const SystemAccess* Registry::debug_swapAccess(const SystemAccess* access) {
+  return std::exchange(tSystemAccess, access);
+}
+
+void Registry::debug_beginAccess(const SystemAccess& access) {
+  for (size_t i = 0; i < ComponentTypeCount; i++) {
+    auto type = static_cast<ComponentType>(i);
+    if (access.mWrites.hasComponent(type)) {
+      debug_writers[i]++;
+      assert(debug_writers[i] == 1 && debug_readers[i] == 0 &&
+             "Systems with conflicting access are running at the same time");
+    } else if (access.mReads.hasComponent(type)) {
+      debug_readers[i]++;
+      assert(debug_writers[i] == 0 &&
+             "Systems with conflicting access are running at the same time");
+    }
+  }
+}
+
+void Registry::debug_endAccess(const SystemAccess& access) {
+  for (size_t i = 0; i < ComponentTypeCount; i++) {
+    auto type = static_cast<ComponentType>(i);
+    if (access.mWrites.hasComponent(type))
+      debug_writers[i]--;
+    else if (access.mReads.hasComponent(type))
+      debug_readers[i]--;
+  }
+}
+#endif
+
 } // namespace selwonk::ecs
@@ -1,43 +1,228 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cmath>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
 #include <tuple>
-#include <variant>
 
+#include "../threadpool.hpp"
 #include "../times.hpp"
 #include "applycommandssystem.hpp"
+#include "archetype.hpp"
+#include "commandbuffer.hpp"
 #include "component.hpp"
 #include "entity.hpp"
+#include "observer.hpp"
+#include "query.hpp"
 
 #include "camera.hpp"
+#include "hierarchy.hpp"
 #include "named.hpp"
+#include "prefab.hpp"
 #include "renderable.hpp"
 #include "system.hpp"
 #include "transform.hpp"
 
 namespace selwonk::ecs {
+class Registry;
+
+// Destroy an entity at the next barrier
+struct DestroyEntity {
+  EntityRef mTarget;
+
+  void apply(Registry& ecs);
+};
+
+// How a registry lays out components in memory
+enum class StorageMode {
+  // Each component in its own array, indexed by entity ID. See Component::Store
+  Arrays,
+  // Entities with the same components share a table, see ArchetypeStorage
+  Archetypes,
+};
+
 class Registry {
+  // Reads and restores storage directly
+  friend class Snapshot;
+
 public:
-  using ComponentArrayTuple = std::tuple<Transform::Store, Named::Store,
-                                         Renderable::Store, Camera::Store>;
+  using ComponentArrayTuple =
+      std::tuple<Transform::Store, Named::Store, Renderable::Store,
+                 Camera::Store, Parent::Store, Children::Store,
+                 WorldTransform::Store>;
+  using ArchetypeTable = ArchetypeStorage<ComponentArrayTuple>::Table;
+
+  explicit Registry(StorageMode storage = StorageMode::Arrays)
+      : mStorage(storage) {}
 
-  using CommandVariant =
-      std::variant<Camera::SetTarget, Transform::SetTransform>;
+  // Every command that may be queued, in the order they are applied at a
+  // barrier. Destruction comes last so that other commands never see an entity
+  // that was destroyed in the same batch
+  using CommandBuffer =
+      ecs::CommandBuffer<Camera::SetTarget, Transform::SetTransform,
+                         Parent::SetParent, Prefab::Instantiate,
+                         DestroyEntity>;
 
   ComponentMask getComponentMask(EntityRef entity);
 
+  // Maximum number of distinct combinations of components that may be
+  // iterated with forEach
+  const static constexpr size_t MaxQueries = 64;
+
+  // Call callback(entity, components...) for every entity with all of the
+  // given components. Matching entities are cached the first time a set of
+  // components is used, so iteration only visits matches. With archetype
+  // storage, every row of each matching table is visited instead. Components
+  // must not be added to or removed from any entity during iteration
   // TODO: Remove non-const version
   template <typename... Components, typename F, bool includeDisabled = false>
   void forEach(F&& callback) {
+    assert((debug_mayRead(Components::Type) && ...) &&
+           "System did not declare access to a component it iterates");
+    if (mStorage == StorageMode::Archetypes) {
+      mArchetypes.forEachTable(
+          searchMask<Components...>(includeDisabled), [&](auto& table) {
+            forEachInTable<Components...>(table, {0, table.size()}, callback);
+          });
+      return;
+    }
+
+    auto& query = getQuery<includeDisabled, Components...>();
+    for (EntityRef::Id id : query.entities()) {
+      EntityRef entity(id, mGenerations[id]);
+      callback(entity, (getComponentArray<Components>().get(entity))...);
+    }
+  }
+
+  // Entities per chunk of ComponentArray. parallelForEach splits work along
+  // these boundaries
+  const static constexpr size_t ChunkSize = 1024;
+
+  // Like forEach, but chunks of entities are processed in parallel on the
+  // calling thread's pool. Returns once every entity has been processed
+  // If any component is stored sparsely, the smallest such set is split
+  // instead, as only its entities can match
+  // The callback must be safe to call from multiple threads at once
+  template <typename... Components, typename F, bool includeDisabled = false>
+  void parallelForEach(F&& callback) {
+    assert((debug_mayRead(Components::Type) && ...) &&
+           "System did not declare access to a component it iterates");
+    auto mask = searchMask<Components...>(includeDisabled);
+
+    if (mStorage == StorageMode::Archetypes) {
+      // Split each matching table into chunks of rows
+      std::vector<std::pair<ArchetypeTable*, ThreadPool::Range>> chunks;
+      mArchetypes.forEachTable(mask, [&](auto& table) {
+        for (size_t begin = 0; begin < table.size(); begin += ChunkSize) {
+          chunks.push_back(
+              {&table, {begin, std::min(begin + ChunkSize, table.size())}});
+        }
+      });
+      auto process = [&](ThreadPool::Range range) {
+        for (size_t i = range.begin; i < range.end; i++) {
+          auto& [table, rows] = chunks[i];
+          forEachInTable<Components...>(*table, rows, callback);
+        }
+      };
+      forEachChunk({0, chunks.size()}, /*grainSize=*/1, process);
+      return;
+    }
+
+    if (auto candidates = smallestSparseSet<Components...>()) {
+      auto process = [&](ThreadPool::Range range) {
+        for (size_t i = range.begin; i < range.end; i++) {
+          auto id = (*candidates)[i];
+          if (!mComponentMasks[id].matches(mask))
+            continue;
+          // Views never allocate, unlike get
+          auto chunk = id / ChunkSize;
+          callback(EntityRef(id, mGenerations[id]),
+                   getComponentArray<Components>().chunkView(chunk)[id]...);
+        }
+      };
+      forEachChunk({0, candidates->size()}, ChunkSize, process);
+      return;
+    }
+
+    size_t chunks = (mNextEntityId + ChunkSize - 1) / ChunkSize;
+    auto process = [&](ThreadPool::Range range) {
+      for (size_t chunk = range.begin; chunk < range.end; chunk++) {
+        forEachInChunk<Components...>(chunk, mask, callback);
+      }
+    };
+
+    forEachChunk({0, chunks}, /*grainSize=*/1, process);
+  }
+
+  // Like ThreadPool::forEachChunk on the calling thread's pool, or a single
+  // call if there is none. Jobs are checked against the access declared by the
+  // calling system, so may use the registry as it could
+  template <typename F>
+  void forEachChunk(ThreadPool::Range range, size_t grainSize, F&& process) {
+    auto* pool = ThreadPool::current();
+    if (pool == nullptr) {
+      process(range);
+      return;
+    }
+#ifndef NDEBUG
+    auto* access = debug_currentAccess();
+    pool->forEachChunk(range, grainSize, [&](ThreadPool::Range chunk) {
+      auto* previous = debug_swapAccess(access);
+      process(chunk);
+      debug_swapAccess(previous);
+    });
+#else
+    pool->forEachChunk(range, grainSize, process);
+#endif
+  }
+
+  // Stamp recording when a component was last changed. Increases before each
+  // phase of systems, so every change made by a phase and the barrier after
+  // it shares a version
+  using ChangeVersion = uint32_t;
+  ChangeVersion changeVersion() const { return mChangeVersion; }
+
+  // Like forEach, but only visits entities where any of the components has
+  // changed at or after `since`. To see every change exactly once or more,
+  // save changeVersion() after iterating and pass it next time. Chunks of
+  // entities without changes are skipped as a whole
+  template <typename... Components, typename F, bool includeDisabled = false>
+  void forEachChanged(ChangeVersion since, F&& callback) {
+    assert((debug_mayRead(Components::Type) && ...) &&
+           "System did not declare access to a component it iterates");
     auto mask = searchMask<Components...>(includeDisabled);
-    for (EntityRef::Id entity = 0; entity < mNextEntityId; entity++) {
-      if (mComponentMasks[entity].matches(mask)) {
-        callback(entity, (getComponentArray<Components>().get(entity))...);
+    size_t chunks = (mNextEntityId + ChunkSize - 1) / ChunkSize;
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+      if (!((chunkChangeVersions<Components>()[chunk] >= since) || ...))
+        continue;
+
+      auto begin = static_cast<EntityRef::Id>(chunk * ChunkSize);
+      auto end = std::min<EntityRef::Id>(begin + ChunkSize, mNextEntityId);
+      for (EntityRef::Id id = begin; id < end; id++) {
+        if (!mComponentMasks[id].matches(mask) ||
+            !((changeVersions<Components>()[id] >= since) || ...))
+          continue;
+        EntityRef entity(id, mGenerations[id]);
+        callback(entity, storedComponent<Components>(entity)...);
       }
     }
   }
 
+  // Record that a component was changed through a reference from forEach or
+  // similar. getComponentMutable and addComponent do so automatically
+  // Safe to call from multiple threads for different entities
+  template <typename T> void markChanged(EntityRef entity) {
+    assert((debug_barrierActive || debug_mayWrite(T::Type)) &&
+           "Only systems that declare they write a component may change it");
+    stampChanged(T::Type, entity.id());
+  }
+
   template <typename... Components>
   static consteval ComponentMask searchMask(bool includeDisabled) {
     ComponentMask mask{};
@@ -54,52 +239,115 @@ public:
   bool alive(EntityRef entity) {
     return getComponentMask(entity).hasFlag(EntityFlag::Alive);
   }
-  constexpr void setEnabled(EntityRef entity, bool enabled) {
-    mComponentMasks[entity.id()].setFlag(EntityFlag::Enabled, enabled);
+  // Re-enabling an entity counts as changing all of its components, as
+  // forEachChanged skipped any changes while it was disabled
+  void setEnabled(EntityRef entity, bool enabled) {
+    checkAlive(entity);
+    auto mask = mComponentMasks[entity.id()];
+    if (enabled && !mask.hasFlag(EntityFlag::Enabled)) {
+      for (size_t i = 0; i < ComponentTypeCount; i++) {
+        auto type = static_cast<ComponentType>(i);
+        if (mask.hasComponent(type))
+          stampChanged(type, entity.id());
+      }
+    }
+    mask.setFlag(EntityFlag::Enabled, enabled);
+    setComponentMask(entity.id(), mask);
   }
 
+  // Create an entity, reusing the ID of a destroyed one if possible
   EntityRef createEntity();
+  // Create `count` entities with consecutive IDs. IDs of destroyed entities are
+  // not reused, as they are unlikely to be consecutive
+  EntityRange createEntities(size_t count);
+  // Destroy an entity and all of its components. Any references to it become
+  // stale, and must not be used. Must only be called when applying a barrier
+  // or outside of updates, see DestroyEntity
+  // If any of its components are observed by OnRemove, the entity lives on
+  // until those observers have been called, at the end of the barrier
+  void destroyEntity(EntityRef entity);
 
+  // Add a component to an entity, replacing any existing one of the same type
   template <typename T>
   void addComponent(EntityRef entity, const T& component) {
     checkAlive(entity);
     // fmt::println("Add {} to {}", T::Name, entity.id());
 
-    getComponentArray<T>().add(entity, component);
-    mComponentMasks[entity.id()].setComponentPresent(T::Type, true);
+    stampChanged(T::Type, entity.id());
+    if (hasComponent<T>(entity)) {
+      storedComponent<T>(entity) = component;
+      return;
+    }
+    mObservers.record(ObserverEvent::Add, T::Type, entity);
+    if (mStorage == StorageMode::Arrays)
+      getComponentArray<T>().add(entity, component);
+    auto mask = mComponentMasks[entity.id()];
+    mask.setComponentPresent(T::Type, true);
+    // Moves the entity to a new table when using archetypes
+    setComponentMask(entity.id(), mask);
+    if (mStorage == StorageMode::Archetypes)
+      storedComponent<T>(entity) = component;
+  }
+
+  // Add components[i] to the i'th entity in the range, none of which may have a
+  // T already. With array storage, whole chunks are written at once. With
+  // archetypes, each entity still moves to its new table individually
+  template <typename T>
+  void addComponents(EntityRange range, std::span<const T> components) {
+    assert(components.size() == range.size());
+    addComponentRange<T>(range, [&](T* out, size_t offset, size_t count) {
+      std::copy_n(components.begin() + offset, count, out);
+    });
+  }
+  // Add the same component to every entity in the range
+  template <typename T>
+  void addComponents(EntityRange range, const T& component) {
+    addComponentRange<T>(range, [&](T* out, size_t offset, size_t count) {
+      std::fill_n(out, count, component);
+    });
   }
 
   template <typename T> const T& getComponent(EntityRef entity) {
     checkAlive(entity);
     assert(hasComponent<T>(entity));
-    return getComponentArray<T>().get(entity);
+    assert(debug_mayRead(T::Type) &&
+           "System did not declare access to a component it reads");
+    return storedComponent<T>(entity);
   }
 
   // Get a mutable component reference, must only be called when applying a
-  // barrier
+  // barrier or from a system that declared it writes T
   template <typename T> T& getComponentMutable(EntityRef entity) {
-    assert(debug_barrierActive &&
-           "getComponentMutable is only allowed during barrier application");
+    assert((debug_barrierActive || debug_mayWrite(T::Type)) &&
+           "getComponentMutable is only allowed during barrier application, "
+           "or by systems that declare they write the component");
     checkAlive(entity);
     assert(hasComponent<T>(entity));
-    return getComponentArray<T>().get(entity);
+    stampChanged(T::Type, entity.id());
+    return storedComponent<T>(entity);
   }
 
-  // Get queued commands, must only be called when applying a
-  // barrier
-  std::vector<CommandVariant>& getQueuedCommands() {
+  // Get the command buffer of every thread that has queued commands, must only
+  // be called when applying a barrier
+  std::span<const std::unique_ptr<CommandBuffer>> getCommandBuffers() {
     assert(debug_barrierActive &&
-           "getQueuedCommands is only allowed during barrier application");
-    return mQueuedCommands;
+           "getCommandBuffers is only allowed during barrier application");
+    return mCommandBuffers;
   }
 
+  StorageMode storageMode() const { return mStorage; }
+  // Arrays are left empty when using archetype storage
   const ComponentArrayTuple& getComponentArrays() const {
     return mComponentArrays;
   }
+  const ArchetypeStorage<ComponentArrayTuple>& getArchetypes() const {
+    return mArchetypes;
+  }
 
   template <typename T> T* addSystem(std::unique_ptr<T> system) {
     auto ptr = system.get();
     mSystems.emplace_back(std::move(system));
+    mScheduleDirty = true;
 
     auto block = ptr->blocksBarriers();
     if (block != std::nullopt && mCommandBlocker == nullptr) {
@@ -111,7 +359,9 @@ public:
 
   // Add a barrier that forces all previous systems to finish before continuing,
   // then apply commands from them
-  // As we don't currently multithread, this just adds the system for now
+  // Between barriers, systems whose access does not conflict run in parallel
+  // on the calling thread's pool, see SystemAccess. Those that do conflict run
+  // in the order they were added
   // There must be at least one barrier, otherwise changes will never be written
   // There may be multiple barriers if systems are interdependent, but overuse
   // should be seen as a code smell
@@ -124,31 +374,285 @@ public:
 
   void update(Duration dt);
 
-  void queueCommand(const CommandVariant&& cmd) {
+  // Call callback(registry, entities) with every entity an event happened to,
+  // such as `observe<OnAdd<Renderable>>(...)`. Events are buffered and
+  // dispatched in a batch after each barrier, removes first, then adds, then
+  // changes. Observers run with the same access as barriers, and anything
+  // they change is dispatched at the next barrier. They may queue commands,
+  // which are applied at the next barrier, in the next update if this was the
+  // last
+  // Must not be called during an update
+  template <typename Event, typename F> void observe(F&& callback) {
+    mObservers.add(Event::Event, Event::Component::Type,
+                   std::forward<F>(callback));
+  }
+
+  // Queue a command to be applied at the next barrier. Safe to call from
+  // systems running in parallel, as each thread has a buffer of its own
+  // If a thread queues several commands of the same type to the same entity,
+  // only its last is applied. Commands from different threads are all applied,
+  // with no defined order between them
+  // Observers may queue commands, but barriers themselves may not
+  template <typename C> void queueCommand(C&& cmd) {
     assert(!debug_commandsBlocked);
-    mQueuedCommands.emplace_back(cmd);
+    assert(!debug_barrierActive &&
+           "Commands may not be queued while applying a barrier");
+    localCommandBuffer().push(std::forward<C>(cmd));
   }
 
 private:
+  const static constexpr size_t ComponentTypeCount =
+      static_cast<size_t>(ComponentType::Max);
+
+  // A system's place in the update schedule
+  struct ScheduledSystem {
+    System* mSystem;
+    SystemAccess mAccess;
+    // Later systems in the same phase that conflict with this one
+    std::vector<size_t> mSuccessors;
+    size_t mPredecessors = 0;
+    // Predecessors yet to finish during the current update
+    std::atomic<size_t> mRemaining = 0;
+  };
+  // Systems that run between two barriers, as a range of mSchedule
+  struct Phase {
+    size_t mBegin;
+    size_t mEnd;
+    // Barrier that follows the systems, if any
+    System* mBarrier;
+    // Does any system in the phase forbid further commands?
+    bool mBlocksCommands;
+  };
+
+  // Split systems into phases at each barrier, and order those that conflict
+  void buildSchedule();
+  void runPhase(const Phase& phase, Duration dt);
+  // Run a system, then start any successors that are now ready
+  void runSystem(ThreadPool* pool, size_t index, Duration dt);
+  void spawnSystem(ThreadPool& pool, size_t index, Duration dt);
+
   void checkAlive(EntityRef entity) { assert(alive(entity)); }
 
+  // Throw if `count` new IDs would go past EntityRef::MaxEntities
+  void reserveIds(size_t count);
+  // Resize per-entity data to fit every ID below mNextEntityId
+  void growEntities();
+  // Change an entity's mask, and update any queries it affects
+  void setComponentMask(EntityRef::Id entity, ComponentMask mask);
+  // Set the change version of an entity's component, and its chunk
+  void stampChanged(ComponentType type, EntityRef::Id entity);
+  template <typename T> std::vector<ChangeVersion>& changeVersions() {
+    return mChangeVersions[static_cast<size_t>(T::Type)];
+  }
+  template <typename T> std::vector<ChangeVersion>& chunkChangeVersions() {
+    return mChunkChangeVersions[static_cast<size_t>(T::Type)];
+  }
+
+  // Get the cached query for a set of components, creating it on first use
+  // Each combination is given a global ID, shared by every registry
+  template <bool includeDisabled, typename... Components> Query& getQuery() {
+    const static size_t id = sNextQueryId.fetch_add(1);
+    if (id >= MaxQueries) [[unlikely]]
+      tooManyQueries(id);
+    if (auto* query = mQuerySlots[id].load(std::memory_order_acquire))
+      return *query;
+    return createQuery(id, searchMask<Components...>(includeDisabled),
+                       smallestSparseSet<Components...>());
+  }
+  // Abort in every build type, as the query would index past mQuerySlots
+  [[noreturn]] static void tooManyQueries(size_t id);
+  // Create a query, or share an existing one with the same mask. If given,
+  // only `candidates` are checked when filling it, rather than every entity
+  Query&
+  createQuery(size_t id, ComponentMask mask,
+              std::optional<std::span<const EntityRef::Id>> candidates);
+
+  // Get the entities of the smallest sparsely stored component, if any.
+  // Entities outside of this set can not have every component
+  template <typename... Components>
+  std::optional<std::span<const EntityRef::Id>> smallestSparseSet() {
+    std::optional<std::span<const EntityRef::Id>> smallest;
+    auto consider = [&]<typename T>() {
+      std::optional<std::span<const EntityRef::Id>> entities;
+      auto& store = getComponentArray<T>();
+      if constexpr (T::Store::Sparse)
+        entities = store.entities();
+      else if constexpr (requires { store.sparseEntities(); })
+        entities = store.sparseEntities();
+      if (entities && (!smallest || entities->size() < smallest->size()))
+        smallest = entities;
+    };
+    (consider.template operator()<Components>(), ...);
+    return smallest;
+  }
+
+  // Sparse arrays are not chunked, so can be viewed with any chunk size
+  template <typename Store>
+  const static constexpr bool MatchesChunkSize = [] {
+    if constexpr (Store::Sparse)
+      return true;
+    else
+      return Store::EntitiesPerChunk == ChunkSize;
+  }();
+
+  template <typename... Components, typename F>
+  void forEachInChunk(size_t chunk, ComponentMask mask, F& callback) {
+    static_assert(
+        (MatchesChunkSize<typename Components::Store> && ...),
+        "Component arrays must use the registry's chunk size");
+    auto views =
+        std::make_tuple(getComponentArray<Components>().chunkView(chunk)...);
+    bool allocated =
+        std::apply([](auto&... view) { return (view.valid() && ...); }, views);
+    if (!allocated)
+      return; // No entity in the chunk has every component
+
+    auto begin = static_cast<EntityRef::Id>(chunk * ChunkSize);
+    auto end = std::min<EntityRef::Id>(begin + ChunkSize, mNextEntityId);
+    std::apply(
+        [&](auto&... view) {
+          for (EntityRef::Id entity = begin; entity < end; entity++) {
+            if (mComponentMasks[entity].matches(mask))
+              callback(EntityRef(entity, mGenerations[entity]),
+                       view[entity]...);
+          }
+        },
+        views);
+  }
+
+  // Call callback(entity, components...) for rows of a table
+  template <typename... Components, typename F>
+  void forEachInTable(ArchetypeTable& table, ThreadPool::Range rows,
+                      F& callback) {
+    auto entities = table.entities();
+    auto process = [&](auto... columns) {
+      for (size_t row = rows.begin; row < rows.end; row++) {
+        auto id = entities[row];
+        callback(EntityRef(id, mGenerations[id]), columns[row]...);
+      }
+    };
+    process(table.template column<Components>()...);
+  }
+
+  // Implementation of addComponents, where write(out, offset, count) fills
+  // components [offset, offset + count) of the range
+  template <typename T, typename F>
+  void addComponentRange(EntityRange range, F&& write) {
+    for (size_t i = 0; i < range.size(); i++) {
+      checkAlive(range[i]);
+      assert(!hasComponent<T>(range[i]) && "Entity already has this component");
+    }
+    if (mStorage == StorageMode::Archetypes) {
+      for (size_t i = 0; i < range.size(); i++) {
+        setComponentPresent(T::Type, range[i].id());
+        write(&storedComponent<T>(range[i]), i, 1);
+      }
+      return;
+    }
+    getComponentArray<T>().addRange(range.mBegin, range.size(), write);
+    for (auto id = range.mBegin; id < range.mEnd; id++) {
+      setComponentPresent(T::Type, id);
+    }
+  }
+  // Mark an entity as having a component, and that the component changed
+  void setComponentPresent(ComponentType type, EntityRef::Id entity);
+  // Call observers with events since the last dispatch, see observe. Entities
+  // destroyed with OnRemove observers are removed once they have been called
+  void dispatchObservers();
+  // Destroy an entity's components and free its ID
+  void removeEntity(EntityRef entity);
+  // Let stores that adapt to occupancy migrate between dense and sparse
+  // storage. Must only be called between updates, when no references to
+  // components are held
+  void rebalanceStores();
+
   template <typename T> T::Store& getComponentArray() {
     return std::get<typename T::Store>(mComponentArrays);
   }
+  // Get an entity's component from whichever storage is in use
+  template <typename T> T& storedComponent(EntityRef entity) {
+    if (mStorage == StorageMode::Archetypes)
+      return mArchetypes.template get<T>(entity.id());
+    return getComponentArray<T>().get(entity);
+  }
 
+  StorageMode mStorage;
   ComponentArrayTuple mComponentArrays;
-  std::vector<CommandVariant> mQueuedCommands;
+  ArchetypeStorage<ComponentArrayTuple> mArchetypes;
+  // Get the calling thread's command buffer, creating it on first use
+  CommandBuffer& localCommandBuffer();
+  // Number of commands queued for the next barrier
+  size_t pendingCommands() const;
+
+  static inline std::atomic<size_t> sNextRegistryId = 0;
+  // Identifies the registry in each thread's cached command buffer
+  const size_t mRegistryId = sNextRegistryId++;
+  // Buffers are only ever added, and are reused each frame by the same thread
+  std::vector<std::unique_ptr<CommandBuffer>> mCommandBuffers;
+  // Thread owning each buffer
+  std::vector<std::thread::id> mCommandThreads;
+  // Guards adding buffers, which only happens the first time a thread queues a
+  // command
+  std::mutex mCommandsMtx;
 
   EntityRef::Id mNextEntityId = 0;
   std::vector<ComponentMask> mComponentMasks;
+  // Current generation of each ID
+  std::vector<EntityRef::Generation> mGenerations;
+  // IDs of destroyed entities, ready for reuse
+  std::vector<EntityRef::Id> mFreeIds;
+
+  // Starts above zero, so that every component counts as changed since 0
+  ChangeVersion mChangeVersion = 1;
+  // Version each entity's components last changed at, by component type
+  std::array<std::vector<ChangeVersion>, ComponentTypeCount> mChangeVersions;
+  // Latest change to any entity of each chunk, by component type
+  std::array<std::vector<ChangeVersion>, ComponentTypeCount>
+      mChunkChangeVersions;
+
+  ObserverList mObservers;
+  // Changes at or after this version are yet to be seen by observers
+  ChangeVersion mDispatchedVersion = 0;
+  // Entities destroyed during the current barrier that are waiting for OnRemove
+  // observers, see destroyEntity
+  std::vector<EntityRef> mPendingDestroy;
+  // Is a barrier or its observers running? Destruction is deferred if so
+  bool mInBarrier = false;
+
+  static inline std::atomic<size_t> sNextQueryId = 0;
+  // Queries indexed by ID, which are filled in on first use so may be read
+  // from multiple threads
+  std::array<std::atomic<Query*>, MaxQueries> mQuerySlots = {};
+  // Distinct queries, which may be shared by several IDs with the same mask
+  std::vector<std::unique_ptr<Query>> mQueries;
+  std::mutex mQueriesMtx;
   std::vector<std::unique_ptr<System>> mSystems;
 
   int mCommandBarrierCount = 0;
-  System* mCommandBlocker;
+  System* mCommandBlocker = nullptr;
+
+  std::vector<ScheduledSystem> mSchedule;
+  std::vector<Phase> mPhases;
+  bool mScheduleDirty = true;
+  // Systems in the current phase that are yet to finish
+  std::atomic<size_t> mPhasePending = 0;
 
 #ifndef NDEBUG
+  // May the system running on this thread, if any, access the component?
+  static bool debug_mayRead(ComponentType type);
+  static bool debug_mayWrite(ComponentType type);
+  // Get or replace the access of the system running on this thread
+  static const SystemAccess* debug_currentAccess();
+  static const SystemAccess* debug_swapAccess(const SystemAccess* access);
+  // Track the components accessed by running systems, and assert that none
+  // conflict. Catches mistakes in the schedule, rather than in declarations
+  void debug_beginAccess(const SystemAccess& access);
+  void debug_endAccess(const SystemAccess& access);
+
   bool debug_commandsBlocked = false;
   bool debug_barrierActive = false;
+  std::array<std::atomic<int>, ComponentTypeCount> debug_readers = {};
+  std::array<std::atomic<int>, ComponentTypeCount> debug_writers = {};
 #endif
 };
 } // namespace selwonk::ecs
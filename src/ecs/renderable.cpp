@@ -0,0 +1,21 @@
+#include "renderable.hpp"
+
+#include "snapshot.hpp"
+
+namespace selwonk::ecs {
+void Renderable::save(SnapshotWriter& out) const {
+  out.write(mMesh != nullptr);
+  if (mMesh != nullptr)
+    out.write(mMesh->mAssetId);
+}
+
+Renderable Renderable::load(SnapshotReader& in) {
+  if (!in.read<bool>())
+    return {};
+  auto& meshes = in.assets().mMeshes;
+  auto mesh = meshes.find(in.read<vulkan::Mesh::AssetId>());
+  if (mesh == meshes.end())
+    throw std::runtime_error("Snapshot refers to a mesh that is not loaded");
+  return {.mMesh = mesh->second};
+}
+} // namespace selwonk::ecs
@@ -5,11 +5,18 @@
 #include "../vk/mesh.hpp"
 
 namespace selwonk::ecs {
+class SnapshotReader;
+class SnapshotWriter;
+
 struct Renderable {
   const static constexpr ComponentType Type = ComponentType::Renderable;
   const static constexpr char* Name = "Renderable";
   using Store = ComponentArray<Renderable>;
 
   std::shared_ptr<vulkan::Mesh> mMesh;
+
+  // The mesh is saved as its asset ID, see Snapshot
+  void save(SnapshotWriter& out) const;
+  static Renderable load(SnapshotReader& in);
 };
 } // namespace selwonk::ecs
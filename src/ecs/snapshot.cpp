@@ -0,0 +1,233 @@
+#include "snapshot.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+#include "../platform.hpp"
+#include "registry.hpp"
+
+namespace selwonk::ecs {
+void Snapshot::save(Registry& ecs, const std::filesystem::path& path) {
+  SnapshotWriter out;
+  auto entityCount = ecs.mNextEntityId;
+  out.write(Header{
+      .mMagic = Magic,
+      .mVersion = Version,
+      .mMaskSize = sizeof(ComponentMask),
+      .mChunkSize = Registry::ChunkSize,
+      .mEntityCount = entityCount,
+      .mFreeCount = static_cast<uint32_t>(ecs.mFreeIds.size()),
+      .mStoreCount = std::tuple_size_v<Registry::ComponentArrayTuple>,
+  });
+  out.write(std::as_bytes(std::span(ecs.mGenerations)));
+  out.write(std::as_bytes(std::span(ecs.mComponentMasks)));
+  out.write(std::as_bytes(std::span(ecs.mFreeIds)));
+
+  std::apply([&](auto&... stores) { (saveStore(ecs, out, stores), ...); },
+             ecs.mComponentArrays);
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  auto data = out.data();
+  file.write(reinterpret_cast<const char*>(data.data()), data.size());
+  if (!file)
+    throw std::runtime_error("Failed to write snapshot " + path.string());
+}
+
+void Snapshot::load(Registry& ecs, const std::filesystem::path& path,
+                    const Assets& assets) {
+  assert(ecs.mNextEntityId == 0 && "Snapshots must be loaded into an empty "
+                                   "registry");
+  MappedFile file(path);
+  SnapshotReader in(file.data(), assets);
+
+  auto header = in.read<Header>();
+  if (header.mMagic != Magic)
+    throw std::runtime_error(path.string() + " is not a snapshot");
+  if (header.mVersion != Version || header.mMaskSize != sizeof(ComponentMask) ||
+      header.mChunkSize != Registry::ChunkSize)
+    throw std::runtime_error(path.string() +
+                             " is from an incompatible version");
+  if (header.mStoreCount != std::tuple_size_v<Registry::ComponentArrayTuple>)
+    throw std::runtime_error(path.string() + " has unknown components");
+
+  if (header.mEntityCount > EntityRef::MaxEntities)
+    throw std::runtime_error(path.string() +
+                             " has more entities than VN_MAXENTITIES allows");
+  ecs.mNextEntityId = header.mEntityCount;
+  ecs.growEntities();
+  auto copyArray = [&](auto& array, size_t count) {
+    using T = std::decay_t<decltype(array)>::value_type;
+    array.resize(count);
+    auto bytes = in.read(count * sizeof(T));
+    // An empty array may have no storage to copy into
+    if (count > 0)
+      std::memcpy(array.data(), bytes.data(), bytes.size());
+  };
+  copyArray(ecs.mGenerations, header.mEntityCount);
+  std::vector<ComponentMask> masks;
+  copyArray(masks, header.mEntityCount);
+  copyArray(ecs.mFreeIds, header.mFreeCount);
+
+  // Queries and archetype tables must learn of every entity before their
+  // components can be stored
+  for (EntityRef::Id id = 0; id < header.mEntityCount; id++) {
+    ecs.setComponentMask(id, masks[id]);
+  }
+  std::apply([&](auto&... stores) { (loadStore(ecs, in, stores), ...); },
+             ecs.mComponentArrays);
+
+  if (ecs.mObservers.anyObserved(ObserverEvent::Add)) {
+    for (EntityRef::Id id = 0; id < header.mEntityCount; id++) {
+      for (size_t type = 0; type < Registry::ComponentTypeCount; type++) {
+        if (masks[id].hasComponent(static_cast<ComponentType>(type)))
+          ecs.mObservers.record(ObserverEvent::Add,
+                                static_cast<ComponentType>(type),
+                                EntityRef(id, ecs.mGenerations[id]));
+      }
+    }
+  }
+  // Everything counts as changed, so that derived data is rebuilt
+  for (size_t type = 0; type < Registry::ComponentTypeCount; type++) {
+    std::ranges::fill(ecs.mChangeVersions[type], ecs.mChangeVersion);
+    std::ranges::fill(ecs.mChunkChangeVersions[type], ecs.mChangeVersion);
+  }
+}
+
+template <typename Store>
+void Snapshot::saveStore(Registry& ecs, SnapshotWriter& out, Store& store) {
+  using T = Store::ValueType;
+  auto sectionStart = out.size();
+  out.write(SectionHeader{
+      .mType = static_cast<uint32_t>(T::Type),
+      .mValueSize = sizeof(T),
+  });
+  auto dataStart = out.size();
+
+  auto has = [&](EntityRef::Id id) {
+    return ecs.mComponentMasks[id].hasComponent(T::Type);
+  };
+  auto entity = [&](EntityRef::Id id) {
+    return EntityRef(id, ecs.mGenerations[id]);
+  };
+
+  if constexpr (TagComponent<T>) {
+    // Tags are fully described by the masks, so the section is empty
+  } else if constexpr (CopyChunks<Store>) {
+    // Index and component count of each chunk that is in use, followed by its
+    // components
+    std::vector<T> gathered;
+    auto chunks = (ecs.mNextEntityId + Registry::ChunkSize - 1) /
+                  Registry::ChunkSize;
+    for (size_t chunk = 0; chunk < chunks; chunk++) {
+      auto begin = static_cast<EntityRef::Id>(chunk * Registry::ChunkSize);
+      auto end = std::min<EntityRef::Id>(begin + Registry::ChunkSize,
+                                         ecs.mNextEntityId);
+      uint32_t count = 0;
+      for (auto id = begin; id < end; id++) {
+        count += has(id);
+      }
+      if (count == 0)
+        continue;
+
+      out.write(static_cast<uint32_t>(chunk));
+      out.write(count);
+      const T* data = nullptr;
+      if (ecs.mStorage == StorageMode::Arrays) {
+        data = store.chunkData(chunk);
+        assert(data != nullptr && "Chunk has components but no storage");
+      } else {
+        gathered.assign(Registry::ChunkSize, T{});
+        for (auto id = begin; id < end; id++) {
+          if (has(id))
+            gathered[id - begin] = ecs.storedComponent<T>(entity(id));
+        }
+        data = gathered.data();
+      }
+      out.write(std::as_bytes(std::span(data, Registry::ChunkSize)));
+    }
+  } else {
+    // Count, followed by the ID and value of each component
+    auto countOffset = out.size();
+    out.write(uint32_t(0));
+    uint32_t count = 0;
+    for (EntityRef::Id id = 0; id < ecs.mNextEntityId; id++) {
+      if (!has(id))
+        continue;
+      count++;
+      out.write(id);
+      auto& value = ecs.storedComponent<T>(entity(id));
+      if constexpr (std::is_trivially_copyable_v<T>)
+        out.write(value);
+      else
+        value.save(out);
+    }
+    out.patch(countOffset, count);
+  }
+
+  out.patch(sectionStart + offsetof(SectionHeader, mBytes),
+            static_cast<uint64_t>(out.size() - dataStart));
+}
+
+template <typename Store>
+void Snapshot::loadStore(Registry& ecs, SnapshotReader& in, Store& store) {
+  using T = Store::ValueType;
+  auto header = in.read<SectionHeader>();
+  if (header.mType != static_cast<uint32_t>(T::Type) ||
+      header.mValueSize != sizeof(T))
+    throw std::runtime_error(std::string("Snapshot layout of ") + T::Name +
+                             " does not match");
+  SnapshotReader section(in.read(header.mBytes), in.assets());
+
+  auto has = [&](EntityRef::Id id) {
+    return ecs.mComponentMasks[id].hasComponent(T::Type);
+  };
+  auto entity = [&](EntityRef::Id id) {
+    if (id >= ecs.mNextEntityId || !has(id))
+      throw std::runtime_error("Snapshot component has no entity");
+    return EntityRef(id, ecs.mGenerations[id]);
+  };
+
+  if constexpr (TagComponent<T>) {
+    if (section.remaining() > 0)
+      throw std::runtime_error(std::string("Snapshot has data for tag ") +
+                               T::Name);
+  } else if constexpr (CopyChunks<Store>) {
+    while (section.remaining() > 0) {
+      auto chunk = section.read<uint32_t>();
+      auto count = section.read<uint32_t>();
+      auto data = section.read(Registry::ChunkSize * sizeof(T));
+      auto begin = static_cast<EntityRef::Id>(chunk * Registry::ChunkSize);
+      if (begin >= ecs.mNextEntityId)
+        throw std::runtime_error("Snapshot chunk has no entities");
+
+      if (ecs.mStorage == StorageMode::Arrays) {
+        std::memcpy(store.restoreChunk(chunk, count), data.data(),
+                    data.size());
+        continue;
+      }
+      auto end = std::min<EntityRef::Id>(begin + Registry::ChunkSize,
+                                         ecs.mNextEntityId);
+      for (auto id = begin; id < end; id++) {
+        if (has(id))
+          std::memcpy(&ecs.storedComponent<T>(entity(id)),
+                      data.data() + (id - begin) * sizeof(T), sizeof(T));
+      }
+    }
+  } else {
+    auto count = section.read<uint32_t>();
+    for (uint32_t i = 0; i < count; i++) {
+      auto ref = entity(section.read<EntityRef::Id>());
+      T value;
+      if constexpr (std::is_trivially_copyable_v<T>)
+        value = section.read<T>();
+      else
+        value = T::load(section);
+
+      if (ecs.mStorage == StorageMode::Arrays)
+        store.add(ref, value);
+      else
+        ecs.storedComponent<T>(ref) = std::move(value);
+    }
+  }
+}
+} // namespace selwonk::ecs
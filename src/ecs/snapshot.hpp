@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "../vk/mesh.hpp"
+#include "component.hpp"
+
+namespace selwonk::ecs {
+class Registry;
+class SnapshotReader;
+class SnapshotWriter;
+
+// Binary copy of a registry's entities and components, for fast loading of
+// large scenes and for checkpointing
+//
+// The file starts with a Header, followed by the generation and mask of every
+// entity, then a section per component store. Components that can be copied
+// byte for byte are stored as whole chunks, which are copied straight into
+// component arrays on load. Others, and sparse components, are stored per
+// entity through their `save` and `load` methods
+// References to GPU resources are stored as asset IDs, which must be resolved
+// through Assets when loading. Values are in native byte order, so snapshots
+// are not portable between architectures
+class Snapshot {
+public:
+  // Increment whenever the layout of the file, or of a component that is
+  // copied byte for byte, changes
+  const static constexpr uint32_t Version = 3;
+
+  // Loaded resources that a snapshot may refer to
+  struct Assets {
+    std::unordered_map<vulkan::Mesh::AssetId, std::shared_ptr<vulkan::Mesh>>
+        mMeshes;
+
+    void addMesh(std::shared_ptr<vulkan::Mesh> mesh) {
+      mMeshes[mesh->mAssetId] = std::move(mesh);
+    }
+  };
+
+  // Write every entity and component in the registry to a file. Must not be
+  // called while systems are running
+  static void save(Registry& ecs, const std::filesystem::path& path);
+  // Restore a snapshot into a registry with no entities. The file is mapped
+  // rather than read, and may use either storage mode
+  // Throws std::runtime_error if the file is not a valid snapshot of the
+  // current version, or refers to assets that are not loaded
+  static void load(Registry& ecs, const std::filesystem::path& path,
+                   const Assets& assets);
+
+private:
+  const static constexpr std::array<char, 4> Magic = {'V', 'N', 'E', 'S'};
+
+  struct Header {
+    std::array<char, 4> mMagic;
+    uint32_t mVersion;
+    // Checked on load, as these change the layout without a version bump
+    uint32_t mMaskSize;
+    uint32_t mChunkSize;
+    uint32_t mEntityCount;
+    uint32_t mFreeCount;
+    uint32_t mStoreCount;
+  };
+  struct SectionHeader {
+    uint32_t mType;
+    uint32_t mValueSize;
+    // Size of the section's data, excluding this header
+    uint64_t mBytes;
+  };
+
+  template <typename Store>
+  static void saveStore(Registry& ecs, SnapshotWriter& out, Store& store);
+  template <typename Store>
+  static void loadStore(Registry& ecs, SnapshotReader& in, Store& store);
+
+  // Are components of the store saved as whole chunks? Only stores with raw
+  // chunks to copy can be
+  template <typename Store>
+  const static constexpr bool CopyChunks =
+      requires(const Store& store) { store.chunkData(0); } &&
+      std::is_trivially_copyable_v<typename Store::ValueType>;
+};
+
+// Appends values to a snapshot being saved
+class SnapshotWriter {
+public:
+  template <typename T> void write(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "Only plain values can be written directly");
+    write(std::as_bytes(std::span(&value, 1)));
+  }
+  void write(std::span<const std::byte> bytes) {
+    mData.insert(mData.end(), bytes.begin(), bytes.end());
+  }
+  // Overwrite a value written earlier, such as a size that was not yet known
+  template <typename T> void patch(size_t offset, const T& value) {
+    std::memcpy(mData.data() + offset, &value, sizeof(T));
+  }
+
+  size_t size() const { return mData.size(); }
+  std::span<const std::byte> data() const { return mData; }
+
+private:
+  std::vector<std::byte> mData;
+};
+
+// Reads values from a snapshot being loaded. Throws std::runtime_error rather
+// than reading past the end
+class SnapshotReader {
+public:
+  SnapshotReader(std::span<const std::byte> data,
+                 const Snapshot::Assets& assets)
+      : mData(data), mAssets(assets) {}
+
+  // The data may not be aligned for T, so is always copied out
+  template <typename T> T read() {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "Only plain values can be read directly");
+    T value;
+    std::memcpy(&value, read(sizeof(T)).data(), sizeof(T));
+    return value;
+  }
+  std::span<const std::byte> read(size_t bytes) {
+    if (bytes > mData.size() - mOffset)
+      throw std::runtime_error("Snapshot is truncated");
+    auto out = mData.subspan(mOffset, bytes);
+    mOffset += bytes;
+    return out;
+  }
+
+  size_t remaining() const { return mData.size() - mOffset; }
+  const Snapshot::Assets& assets() const { return mAssets; }
+
+private:
+  std::span<const std::byte> mData;
+  size_t mOffset = 0;
+  const Snapshot::Assets& mAssets;
+};
+} // namespace selwonk::ecs
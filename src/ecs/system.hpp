@@ -1,10 +1,41 @@
 #pragma once
 
+#include <optional>
+#include <string_view>
+
 #include "../times.hpp"
+#include "component.hpp"
 
 namespace selwonk::ecs {
 class Registry;
 
+// Components that a system reads and writes, used to decide which systems may
+// run at the same time. Components changed through queued commands should be
+// declared as writes, so that commands from different systems are applied in a
+// consistent order
+struct SystemAccess {
+  ComponentMask mReads;
+  ComponentMask mWrites;
+  // Must run on the thread that calls Registry::update, such as to use the
+  // window or record GPU commands
+  bool mMainThread = false;
+
+  // Would running both systems at once cause a data race?
+  constexpr bool conflicts(const SystemAccess& other) const {
+    return mWrites.overlaps(other.mReads) || mWrites.overlaps(other.mWrites) ||
+           other.mWrites.overlaps(mReads);
+  }
+
+  // Access to every component, on the main thread
+  consteval static SystemAccess exclusive() {
+    return {
+        .mReads = ComponentMask::allComponents(),
+        .mWrites = ComponentMask::allComponents(),
+        .mMainThread = true,
+    };
+  }
+};
+
 class System {
 public:
   virtual void update(ecs::Registry& registry, Duration dt) = 0;
@@ -14,6 +45,33 @@ public:
     return std::nullopt;
   }
   virtual std::string_view name() const noexcept = 0;
+  // Components accessed by this system. By default, a system may access
+  // anything and so runs alone. Prefer TypedSystem over overriding this
+  virtual SystemAccess access() const noexcept {
+    return SystemAccess::exclusive();
+  }
   virtual ~System() = default;
 };
+
+template <typename... Components> struct Reads {};
+template <typename... Components> struct Writes {};
+
+// A system that declares the components it accesses, allowing it to run in
+// parallel with systems that do not conflict with it. For example:
+// `class Gravity : public TypedSystem<Reads<Mass>, Writes<Transform>>`
+template <typename ReadList, typename WriteList = Writes<>,
+          bool MainThread = false>
+class TypedSystem;
+
+template <typename... R, typename... W, bool MainThread>
+class TypedSystem<Reads<R...>, Writes<W...>, MainThread> : public System {
+public:
+  SystemAccess access() const noexcept final {
+    return {
+        .mReads = ComponentMask::of<R...>(),
+        .mWrites = ComponentMask::of<W...>(),
+        .mMainThread = MainThread,
+    };
+  }
+};
 } // namespace selwonk::ecs
@@ -41,6 +41,16 @@ struct Transform {
   glm::vec3 mScale = glm::vec3(1.0f);
 };
 
+// World space model matrix, derived from an entity's Transform and those of
+// any parents by HierarchySystem
+struct WorldTransform {
+  const static constexpr ComponentType Type = ComponentType::WorldTransform;
+  const static constexpr char* Name = "WorldTransform";
+  using Store = ComponentArray<WorldTransform>;
+
+  glm::mat4 mMatrix = glm::mat4(1.0f);
+};
+
 struct Transform::SetTransform {
   EntityRef mTarget;
   Transform mNewData;
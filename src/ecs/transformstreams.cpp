@@ -0,0 +1,246 @@
+#include "transformstreams.hpp"
+
+#include <cassert>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace selwonk::ecs {
+namespace {
+static_assert(sizeof(glm::mat4) == 16 * sizeof(float),
+              "Matrices are written as 16 packed floats");
+
+// Each kernel builds the 16 elements of a matrix for several transforms at
+// once, one transform per lane, then transposes them into packed matrices.
+// Elements are in glm's column major order, for M = T * R * S:
+//   Column 0..2: rotation column * scale, with w = 0
+//   Column 3: translation, with w = 1
+// Returns the number of transforms converted, the remainder is left for the
+// scalar path
+#if defined(__x86_64__)
+using Stream = TransformStreams::Stream;
+
+// SSE2 is always available on x86-64, 4 transforms at a time
+size_t toMatricesSse(const TransformStreams& streams, float* out) {
+  const float* tx = streams.stream(Stream::TranslationX);
+  const float* ty = streams.stream(Stream::TranslationY);
+  const float* tz = streams.stream(Stream::TranslationZ);
+  const float* rx = streams.stream(Stream::RotationX);
+  const float* ry = streams.stream(Stream::RotationY);
+  const float* rz = streams.stream(Stream::RotationZ);
+  const float* rw = streams.stream(Stream::RotationW);
+  const float* sx = streams.stream(Stream::ScaleX);
+  const float* sy = streams.stream(Stream::ScaleY);
+  const float* sz = streams.stream(Stream::ScaleZ);
+
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 two = _mm_set1_ps(2.0f);
+  size_t count = streams.size() & ~size_t(3);
+  for (size_t i = 0; i < count; i += 4) {
+    __m128 x = _mm_loadu_ps(rx + i);
+    __m128 y = _mm_loadu_ps(ry + i);
+    __m128 z = _mm_loadu_ps(rz + i);
+    __m128 w = _mm_loadu_ps(rw + i);
+    __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y);
+    __m128 zz = _mm_mul_ps(z, z), xy = _mm_mul_ps(x, y);
+    __m128 xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+    __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y);
+    __m128 wz = _mm_mul_ps(w, z);
+    __m128 scaleX = _mm_loadu_ps(sx + i);
+    __m128 scaleY = _mm_loadu_ps(sy + i);
+    __m128 scaleZ = _mm_loadu_ps(sz + i);
+
+    // Rows of elements, one transform per lane
+    __m128 m[16];
+    m[0] = _mm_mul_ps(
+        _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), scaleX);
+    m[1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), scaleX);
+    m[2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), scaleX);
+    m[3] = zero;
+    m[4] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), scaleY);
+    m[5] = _mm_mul_ps(
+        _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), scaleY);
+    m[6] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), scaleY);
+    m[7] = zero;
+    m[8] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), scaleZ);
+    m[9] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), scaleZ);
+    m[10] = _mm_mul_ps(
+        _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), scaleZ);
+    m[11] = zero;
+    m[12] = _mm_loadu_ps(tx + i);
+    m[13] = _mm_loadu_ps(ty + i);
+    m[14] = _mm_loadu_ps(tz + i);
+    m[15] = one;
+
+    // Each column of 4 rows becomes that column of 4 matrices
+    for (size_t column = 0; column < 4; column++) {
+      __m128* rows = m + column * 4;
+      _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+      for (size_t lane = 0; lane < 4; lane++) {
+        _mm_storeu_ps(out + (i + lane) * 16 + column * 4, rows[lane]);
+      }
+    }
+  }
+  return count;
+}
+
+// Transpose 8 rows of 8 transforms into 8 elements of each transform
+__attribute__((target("avx2,fma"))) void transpose8(__m256 (&rows)[8]) {
+  __m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+  __m256 t1 = _mm256_unpackhi_ps(rows[0], rows[1]);
+  __m256 t2 = _mm256_unpacklo_ps(rows[2], rows[3]);
+  __m256 t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+  __m256 t4 = _mm256_unpacklo_ps(rows[4], rows[5]);
+  __m256 t5 = _mm256_unpackhi_ps(rows[4], rows[5]);
+  __m256 t6 = _mm256_unpacklo_ps(rows[6], rows[7]);
+  __m256 t7 = _mm256_unpackhi_ps(rows[6], rows[7]);
+  // Transforms 0-3 in the low half, and 4-7 in the high half
+  __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+  rows[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+  rows[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+  rows[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+  rows[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+  rows[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+  rows[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+  rows[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+  rows[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+// 8 transforms at a time, on CPUs with AVX2 and FMA
+__attribute__((target("avx2,fma"))) size_t
+toMatricesAvx2(const TransformStreams& streams, float* out) {
+  const float* tx = streams.stream(Stream::TranslationX);
+  const float* ty = streams.stream(Stream::TranslationY);
+  const float* tz = streams.stream(Stream::TranslationZ);
+  const float* rx = streams.stream(Stream::RotationX);
+  const float* ry = streams.stream(Stream::RotationY);
+  const float* rz = streams.stream(Stream::RotationZ);
+  const float* rw = streams.stream(Stream::RotationW);
+  const float* sx = streams.stream(Stream::ScaleX);
+  const float* sy = streams.stream(Stream::ScaleY);
+  const float* sz = streams.stream(Stream::ScaleZ);
+
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 two = _mm256_set1_ps(2.0f);
+  size_t count = streams.size() & ~size_t(7);
+  for (size_t i = 0; i < count; i += 8) {
+    __m256 x = _mm256_loadu_ps(rx + i);
+    __m256 y = _mm256_loadu_ps(ry + i);
+    __m256 z = _mm256_loadu_ps(rz + i);
+    __m256 w = _mm256_loadu_ps(rw + i);
+    __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y);
+    __m256 zz = _mm256_mul_ps(z, z), xy = _mm256_mul_ps(x, y);
+    __m256 xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+    __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y);
+    __m256 wz = _mm256_mul_ps(w, z);
+    __m256 scaleX = _mm256_loadu_ps(sx + i);
+    __m256 scaleY = _mm256_loadu_ps(sy + i);
+    __m256 scaleZ = _mm256_loadu_ps(sz + i);
+
+    // Columns 0 and 1, then 2 and 3, as rows of elements
+    __m256 low[8];
+    low[0] = _mm256_mul_ps(
+        _mm256_fnmadd_ps(two, _mm256_add_ps(yy, zz), one), scaleX);
+    low[1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), scaleX);
+    low[2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), scaleX);
+    low[3] = zero;
+    low[4] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), scaleY);
+    low[5] = _mm256_mul_ps(
+        _mm256_fnmadd_ps(two, _mm256_add_ps(xx, zz), one), scaleY);
+    low[6] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), scaleY);
+    low[7] = zero;
+    __m256 high[8];
+    high[0] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), scaleZ);
+    high[1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), scaleZ);
+    high[2] = _mm256_mul_ps(
+        _mm256_fnmadd_ps(two, _mm256_add_ps(xx, yy), one), scaleZ);
+    high[3] = zero;
+    high[4] = _mm256_loadu_ps(tx + i);
+    high[5] = _mm256_loadu_ps(ty + i);
+    high[6] = _mm256_loadu_ps(tz + i);
+    high[7] = one;
+
+    transpose8(low);
+    transpose8(high);
+    for (size_t lane = 0; lane < 8; lane++) {
+      _mm256_storeu_ps(out + (i + lane) * 16, low[lane]);
+      _mm256_storeu_ps(out + (i + lane) * 16 + 8, high[lane]);
+    }
+  }
+  return count;
+}
+#endif
+} // namespace
+
+void TransformStreams::push(const Transform& transform) {
+  auto set = [&](Stream stream, float value) {
+    mStreams[static_cast<size_t>(stream)].push_back(value);
+  };
+  set(Stream::TranslationX, transform.mTranslation.x);
+  set(Stream::TranslationY, transform.mTranslation.y);
+  set(Stream::TranslationZ, transform.mTranslation.z);
+  set(Stream::RotationX, transform.mRotation.x);
+  set(Stream::RotationY, transform.mRotation.y);
+  set(Stream::RotationZ, transform.mRotation.z);
+  set(Stream::RotationW, transform.mRotation.w);
+  set(Stream::ScaleX, transform.mScale.x);
+  set(Stream::ScaleY, transform.mScale.y);
+  set(Stream::ScaleZ, transform.mScale.z);
+}
+
+void TransformStreams::clear() {
+  for (auto& stream : mStreams) {
+    stream.clear();
+  }
+}
+
+void TransformStreams::toMatrices(std::span<glm::mat4> out) const {
+  assert(out.size() >= size() && "Output is too small");
+  auto* floats = reinterpret_cast<float*>(out.data());
+  size_t done = 0;
+#if defined(__x86_64__)
+  const static bool HasAvx2 =
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  done = HasAvx2 ? toMatricesAvx2(*this, floats) : toMatricesSse(*this, floats);
+#endif
+  toMatricesScalar(done, floats);
+}
+
+void TransformStreams::toMatricesScalar(size_t begin, float* out) const {
+  for (size_t i = begin; i < size(); i++) {
+    auto get = [&](Stream s) { return stream(s)[i]; };
+    float x = get(Stream::RotationX), y = get(Stream::RotationY);
+    float z = get(Stream::RotationZ), w = get(Stream::RotationW);
+    float scaleX = get(Stream::ScaleX), scaleY = get(Stream::ScaleY);
+    float scaleZ = get(Stream::ScaleZ);
+
+    float* m = out + i * 16;
+    m[0] = (1 - 2 * (y * y + z * z)) * scaleX;
+    m[1] = 2 * (x * y + w * z) * scaleX;
+    m[2] = 2 * (x * z - w * y) * scaleX;
+    m[3] = 0;
+    m[4] = 2 * (x * y - w * z) * scaleY;
+    m[5] = (1 - 2 * (x * x + z * z)) * scaleY;
+    m[6] = 2 * (y * z + w * x) * scaleY;
+    m[7] = 0;
+    m[8] = 2 * (x * z + w * y) * scaleZ;
+    m[9] = 2 * (y * z - w * x) * scaleZ;
+    m[10] = (1 - 2 * (x * x + y * y)) * scaleZ;
+    m[11] = 0;
+    m[12] = get(Stream::TranslationX);
+    m[13] = get(Stream::TranslationY);
+    m[14] = get(Stream::TranslationZ);
+    m[15] = 1;
+  }
+}
+} // namespace selwonk::ecs
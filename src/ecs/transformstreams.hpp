@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "transform.hpp"
+
+namespace selwonk::ecs {
+// Transforms stored as separate streams of each scalar (structure of arrays),
+// so that a batch can be converted to model matrices several at a time with
+// SIMD. Produces the same result as Transform::modelMatrix
+class TransformStreams {
+public:
+  enum class Stream : size_t {
+    TranslationX,
+    TranslationY,
+    TranslationZ,
+    RotationX,
+    RotationY,
+    RotationZ,
+    RotationW,
+    ScaleX,
+    ScaleY,
+    ScaleZ,
+    Max,
+  };
+
+  void push(const Transform& transform);
+  void clear();
+  size_t size() const { return mStreams[0].size(); }
+
+  const float* stream(Stream stream) const {
+    return mStreams[static_cast<size_t>(stream)].data();
+  }
+
+  // Write the model matrix of every transform to `out`, which must be at least
+  // size() long. Uses AVX2 or SSE where available
+  void toMatrices(std::span<glm::mat4> out) const;
+
+private:
+  const static constexpr size_t StreamCount =
+      static_cast<size_t>(Stream::Max);
+
+  // Convert transforms [begin, size()) one at a time
+  void toMatricesScalar(size_t begin, float* out) const;
+
+  std::array<std::vector<float>, StreamCount> mStreams;
+};
+} // namespace selwonk::ecs
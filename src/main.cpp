@@ -1,3 +1,4 @@
+#include "benchmark.hpp"
 #include "core/cli.hpp"
 #include "core/settings.hpp"
 #include "core/window.hpp"
@@ -10,6 +11,18 @@ int main(int argc, char** argv) {
     cli.parser.printHelp();
     return 0;
   }
+  if (cli.benchThreadPool) {
+    selwonk::Benchmark::threadPoolScaling();
+    return 0;
+  }
+  if (cli.benchEcs) {
+    selwonk::Benchmark::ecsScaling();
+    return 0;
+  }
+  if (cli.benchTransforms) {
+    selwonk::Benchmark::transformMatrices();
+    return 0;
+  }
   selwonk::core::Settings settings;
 
   selwonk::core::Window window(settings);
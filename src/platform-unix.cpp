@@ -1,7 +1,16 @@
 #include "platform.hpp"
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <cassert>
+#include <cstdint>
+#include <stdexcept>
+
 namespace selwonk {
 std::filesystem::path Platform::getExePath() {
   char path[FILENAME_MAX];
@@ -12,4 +21,97 @@ std::filesystem::path Platform::getExePath() {
   return std::filesystem::path(path);
 }
 
+bool Platform::pinThread(unsigned int core) {
+  if (core >= CPU_SETSIZE)
+    return false;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    throw std::runtime_error("Failed to open " + path.string());
+  struct stat info;
+  if (fstat(fd, &info) == -1) {
+    close(fd);
+    throw std::runtime_error("Failed to stat " + path.string());
+  }
+
+  mSize = info.st_size;
+  // Zero-length mappings are not allowed, leave the view empty instead
+  if (mSize > 0) {
+    void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Failed to map " + path.string());
+    }
+    mData = static_cast<const std::byte*>(data);
+  }
+  // The mapping keeps the file alive
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (mData != nullptr)
+    munmap(const_cast<std::byte*>(mData), mSize);
+}
+
+VirtualMemory::VirtualMemory(size_t bytes) {
+  // Transparent huge pages are only used for aligned regions, so over-reserve
+  // and trim the ends to start on one
+  auto hugePage = hugePageSize();
+  auto pages = pageSize();
+  mSize = (bytes + pages - 1) / pages * pages;
+  // Not counted against the commit limit until touched
+  void* reserved = mmap(nullptr, mSize + hugePage, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (reserved == MAP_FAILED)
+    throw std::runtime_error("Failed to reserve address space");
+
+  auto start = reinterpret_cast<uintptr_t>(reserved);
+  auto aligned = (start + hugePage - 1) / hugePage * hugePage;
+  if (aligned > start)
+    munmap(reserved, aligned - start);
+  auto tail = hugePage - (aligned - start);
+  if (tail > 0)
+    munmap(reinterpret_cast<void*>(aligned + mSize), tail);
+  mData = reinterpret_cast<std::byte*>(aligned);
+
+  // Only advice, so carry on with normal pages if huge pages are unavailable
+  madvise(mData, mSize, MADV_HUGEPAGE);
+}
+
+VirtualMemory::~VirtualMemory() {
+  if (mData != nullptr)
+    munmap(mData, mSize);
+}
+
+VirtualMemory& VirtualMemory::operator=(VirtualMemory&& other) noexcept {
+  if (this != &other) {
+    if (mData != nullptr)
+      munmap(mData, mSize);
+    mData = std::exchange(other.mData, nullptr);
+    mSize = std::exchange(other.mSize, 0);
+  }
+  return *this;
+}
+
+void VirtualMemory::release(size_t offset, size_t bytes) {
+  assert(offset % pageSize() == 0 && bytes % pageSize() == 0 &&
+         "Can only release whole pages");
+  assert(offset + bytes <= mSize && "Releasing outside of the range");
+  // Private anonymous pages read as zero again after this
+  madvise(mData + offset, bytes, MADV_DONTNEED);
+}
+
+size_t VirtualMemory::pageSize() {
+  static const size_t size = sysconf(_SC_PAGESIZE);
+  return size;
+}
+
+size_t VirtualMemory::hugePageSize() { return 2 * 1024 * 1024; }
+
 } // namespace selwonk
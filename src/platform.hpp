@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstddef>
 #include <filesystem>
+#include <span>
+#include <utility>
 
 namespace selwonk {
 // Platform-specific functions
@@ -8,8 +11,63 @@ namespace selwonk {
 class Platform {
 public:
   static std::filesystem::path getExePath();
+  // Restrict the calling thread to a single CPU core. Returns false if the
+  // core does not exist or the platform refused
+  static bool pinThread(unsigned int core);
 
 private:
   Platform() = delete;
 };
+
+// Read-only view of an entire file, mapped into memory rather than read so
+// that pages are only loaded as they are touched
+class MappedFile {
+public:
+  // Throws std::runtime_error if the file can not be opened
+  explicit MappedFile(const std::filesystem::path& path);
+  ~MappedFile();
+
+  // No copy
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  std::span<const std::byte> data() const { return {mData, mSize}; }
+
+private:
+  const std::byte* mData = nullptr;
+  size_t mSize = 0;
+};
+
+// Reserved range of address space, only backed by memory once touched. Pages
+// read as zero when first touched, and again after being released. Advised
+// to use transparent huge pages, to reduce TLB misses when walking large ranges
+class VirtualMemory {
+public:
+  VirtualMemory() = default;
+  // Throws std::runtime_error if the range can not be reserved
+  explicit VirtualMemory(size_t bytes);
+  ~VirtualMemory();
+
+  // No copy
+  VirtualMemory(const VirtualMemory&) = delete;
+  VirtualMemory& operator=(const VirtualMemory&) = delete;
+  VirtualMemory(VirtualMemory&& other) noexcept { *this = std::move(other); }
+  VirtualMemory& operator=(VirtualMemory&& other) noexcept;
+
+  std::byte* data() const { return mData; }
+  size_t size() const { return mSize; }
+
+  // Return the memory backing [offset, offset + bytes) to the system. Both
+  // must be multiples of pageSize()
+  void release(size_t offset, size_t bytes);
+
+  static size_t pageSize();
+  // Size of a transparent huge page. Releasing part of one splits it back into
+  // normal pages
+  static size_t hugePageSize();
+
+private:
+  std::byte* mData = nullptr;
+  size_t mSize = 0;
+};
 } // namespace selwonk
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "threadpool.hpp"
+
+namespace selwonk {
+// Where a suspended coroutine continues once the operation it is waiting on
+// completes. Captured when suspending on a pool thread, in which case the
+// coroutine is resumed as a new job on the same pool at the same priority.
+// Otherwise, it is resumed directly by whichever thread completed the operation
+class ResumeContext {
+public:
+  static ResumeContext capture() {
+    ResumeContext context;
+    context.mPool = ThreadPool::current();
+    if (context.mPool != nullptr)
+      context.mPriority = context.mPool->currentPriority();
+    return context;
+  }
+
+  void resume(std::coroutine_handle<> handle) const {
+    if (mPool == nullptr) {
+      handle.resume();
+      return;
+    }
+    mPool->addJob([handle] { handle.resume(); }, {.priority = mPriority});
+  }
+
+  ThreadPool* pool() const { return mPool; }
+  ThreadPool::Priority priority() const { return mPriority; }
+
+private:
+  ThreadPool* mPool = nullptr;
+  ThreadPool::Priority mPriority = ThreadPool::Priority::Normal;
+};
+
+template <typename T = void> class Task;
+
+namespace detail {
+class TaskPromiseBase {
+public:
+  // Tasks are lazy, and start when first awaited
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  // Continue straight into whoever awaited us, without growing the stack
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename P>
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<P> handle) noexcept {
+      auto continuation = handle.promise().mContinuation;
+      if (continuation)
+        return continuation;
+      return std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() { mException = std::current_exception(); }
+
+  std::coroutine_handle<> mContinuation;
+
+protected:
+  void rethrow() {
+    if (mException)
+      std::rethrow_exception(mException);
+  }
+
+private:
+  std::exception_ptr mException;
+};
+
+template <typename T> class TaskPromise : public TaskPromiseBase {
+public:
+  Task<T> get_return_object();
+
+  template <typename U> void return_value(U&& value) {
+    mValue.emplace(std::forward<U>(value));
+  }
+  T result() {
+    rethrow();
+    return std::move(*mValue);
+  }
+
+private:
+  std::optional<T> mValue;
+};
+
+template <> class TaskPromise<void> : public TaskPromiseBase {
+public:
+  Task<void> get_return_object();
+
+  void return_void() {}
+  void result() { rethrow(); }
+};
+
+// Fire and forget coroutine that starts immediately and frees itself on
+// completion. Used to drive tasks from outside of a coroutine
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    // Exceptions are captured by the inner task, so never reach here
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+} // namespace detail
+
+// A coroutine that produces a T. Does nothing until awaited with co_await,
+// and then runs on the awaiting thread until it first suspends
+// Coroutines suspend rather than block when waiting on I/O, GPU work, or other
+// tasks, leaving the thread free to run other jobs. They are resumed on the
+// pool they were running on, see ResumeContext. Use resumeOn to move onto a
+// pool in the first place, and syncWait to run a task from outside of a
+// coroutine
+// Exceptions thrown by the task are rethrown to whoever awaits it
+template <typename T> class [[nodiscard]] Task {
+public:
+  using promise_type = detail::TaskPromise<T>;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  Task() = default;
+  Task(Task&& other) noexcept : mHandle(std::exchange(other.mHandle, {})) {}
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      if (mHandle)
+        mHandle.destroy();
+      mHandle = std::exchange(other.mHandle, {});
+    }
+    return *this;
+  }
+  ~Task() {
+    if (mHandle)
+      mHandle.destroy();
+  }
+
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  bool valid() const { return static_cast<bool>(mHandle); }
+  bool done() const { return mHandle.done(); }
+
+  // Start the task and wait for its result
+  auto operator co_await() && noexcept {
+    struct Awaiter {
+      Handle mHandle;
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+        mHandle.promise().mContinuation = awaiting;
+        return mHandle;
+      }
+      T await_resume() { return mHandle.promise().result(); }
+    };
+    assert(valid() && "Awaiting an empty task");
+    return Awaiter{mHandle};
+  }
+
+  // Start the task and wait for it to finish, without taking its result
+  auto ready() noexcept {
+    struct Awaiter {
+      Handle mHandle;
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+        mHandle.promise().mContinuation = awaiting;
+        return mHandle;
+      }
+      void await_resume() noexcept {}
+    };
+    assert(valid() && "Awaiting an empty task");
+    return Awaiter{mHandle};
+  }
+
+  // Get the result of a task that has finished. Rethrows any exception
+  T result() {
+    assert(done() && "Task has not finished");
+    return mHandle.promise().result();
+  }
+
+private:
+  friend promise_type;
+  explicit Task(Handle handle) : mHandle(handle) {}
+
+  Handle mHandle;
+};
+
+template <typename T> Task<T> detail::TaskPromise<T>::get_return_object() {
+  return Task<T>(Task<T>::Handle::from_promise(*this));
+}
+inline Task<void> detail::TaskPromise<void>::get_return_object() {
+  return Task<void>(Task<void>::Handle::from_promise(*this));
+}
+
+// Suspend the calling coroutine, and continue it as a job on the pool
+inline auto
+resumeOn(ThreadPool& pool,
+         ThreadPool::Priority priority = ThreadPool::Priority::Normal) {
+  struct Awaiter {
+    ThreadPool& mPool;
+    ThreadPool::Priority mPriority;
+    bool await_ready() noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+      mPool.addJob([handle] { handle.resume(); }, {.priority = mPriority});
+    }
+    void await_resume() noexcept {}
+  };
+  return Awaiter{pool, priority};
+}
+
+// Run every task concurrently, and wait for them all to finish. Tasks are
+// started as separate jobs when awaited from a pool thread, and one after the
+// other otherwise. If any task throws, the first exception is rethrown once
+// all have finished
+inline auto whenAll(std::vector<Task<void>>& tasks) {
+  struct Awaiter {
+    std::vector<Task<void>>& mTasks;
+    ResumeContext mContext;
+    std::coroutine_handle<> mAwaiting;
+    // Unfinished tasks, plus one until all have been started
+    std::atomic<size_t> mRemaining = 0;
+
+    static detail::DetachedTask run(Task<void>& task, Awaiter& self) {
+      co_await task.ready();
+      self.finishOne();
+    }
+    // Returns true if this was the last task
+    bool countDown() {
+      return mRemaining.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+    void finishOne() {
+      // Nothing may be touched after resuming, as we live in the awaiting
+      // coroutine's frame
+      if (countDown())
+        mContext.resume(mAwaiting);
+    }
+
+    bool await_ready() noexcept { return mTasks.empty(); }
+    bool await_suspend(std::coroutine_handle<> awaiting) {
+      mAwaiting = awaiting;
+      mContext = ResumeContext::capture();
+      mRemaining.store(mTasks.size() + 1, std::memory_order_relaxed);
+      for (auto& task : mTasks) {
+        if (auto* pool = mContext.pool()) {
+          pool->addJob([&task, this] { run(task, *this); },
+                       {.priority = mContext.priority()});
+        } else {
+          run(task, *this);
+        }
+      }
+      // Don't suspend at all if every task finished while we were starting
+      // them
+      return !countDown();
+    }
+    void await_resume() {
+      for (auto& task : mTasks) {
+        task.result();
+      }
+    }
+  };
+  return Awaiter{tasks};
+}
+
+// Run a task to completion from outside of a coroutine, helping the pool in
+// the meantime
+template <typename T> T syncWait(ThreadPool& pool, Task<T> task) {
+  std::atomic<size_t> pending = 1;
+  auto signal = [](Task<T>& task, ThreadPool& pool,
+                   std::atomic<size_t>& pending) -> detail::DetachedTask {
+    co_await task.ready();
+    pool.countDown(pending);
+  };
+  signal(task, pool, pending);
+  pool.helpUntilZero(pending);
+  return task.result();
+}
+} // namespace selwonk
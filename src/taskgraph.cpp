@@ -0,0 +1,91 @@
+#include "taskgraph.hpp"
+
+#include <cassert>
+#include <stdexcept>
+
+namespace selwonk {
+
+TaskGraph::Node TaskGraph::add(std::string_view name, Task task) {
+  mNodes.push_back({.mName = std::string(name), .mTask = std::move(task)});
+  mDirty = true;
+  return mNodes.size() - 1;
+}
+
+void TaskGraph::precede(Node before, Node after) {
+  assert(before < mNodes.size() && after < mNodes.size());
+  mNodes[before].mSuccessors.push_back(after);
+  mNodes[after].mPredecessors++;
+  mDirty = true;
+}
+
+void TaskGraph::compile() {
+  mDirty = false;
+  mSources.clear();
+  mRemaining = std::vector<std::atomic<int>>(mNodes.size());
+
+  // Kahn's algorithm, if we can't visit every node there must be a cycle
+  std::vector<int> remaining(mNodes.size());
+  std::vector<Node> ready;
+  for (Node i = 0; i < mNodes.size(); i++) {
+    remaining[i] = mNodes[i].mPredecessors;
+    if (remaining[i] == 0) {
+      mSources.push_back(i);
+      ready.push_back(i);
+    }
+  }
+
+  size_t visited = 0;
+  while (!ready.empty()) {
+    Node node = ready.back();
+    ready.pop_back();
+    visited++;
+    for (Node next : mNodes[node].mSuccessors) {
+      if (--remaining[next] == 0)
+        ready.push_back(next);
+    }
+  }
+
+  if (visited != mNodes.size()) {
+    throw std::logic_error("TaskGraph contains a cycle");
+  }
+}
+
+ThreadPool::JobHandle TaskGraph::submit(ThreadPool& pool,
+                                        ThreadPool::Priority priority) {
+  assert(pool.complete(mSubmission) &&
+         "TaskGraph submitted while the previous submission is running");
+  if (mDirty)
+    compile();
+  mPriority = priority;
+
+  for (Node i = 0; i < mNodes.size(); i++) {
+    mRemaining[i].store(mNodes[i].mPredecessors, std::memory_order_relaxed);
+  }
+
+  // Every node is a child of the root, so the root completes once they have
+  mSubmission = pool.addJob(
+      [this, &pool] {
+        mRoot = pool.currentJob();
+        for (Node node : mSources) {
+          spawn(pool, node);
+        }
+      },
+      {.priority = priority});
+  return mSubmission;
+}
+
+void TaskGraph::spawn(ThreadPool& pool, Node node) {
+  pool.addJob([this, &pool, node] { runNode(pool, node); },
+              {.parent = mRoot, .priority = mPriority});
+}
+
+void TaskGraph::runNode(ThreadPool& pool, Node node) {
+  mNodes[node].mTask();
+  for (Node next : mNodes[node].mSuccessors) {
+    if (mRemaining[next].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      spawn(pool, next);
+    }
+  }
+}
+
+} // namespace selwonk
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "threadpool.hpp"
+
+namespace selwonk {
+// A reusable set of tasks and the order they must run in. Build once, then
+// submit as many times as needed, such as once per frame
+// Tasks with no path between them may run concurrently
+class TaskGraph {
+public:
+  using Node = size_t;
+  using Task = std::function<void()>;
+
+  Node add(std::string_view name, Task task);
+  // Require that `before` completes before `after` starts
+  void precede(Node before, Node after);
+
+  // Run every task on the pool at the given priority. The returned handle
+  // completes once all tasks have. Must not be called while a previous
+  // submission is still running
+  ThreadPool::JobHandle
+  submit(ThreadPool& pool,
+         ThreadPool::Priority priority = ThreadPool::Priority::Normal);
+
+  size_t size() const { return mNodes.size(); }
+  std::string_view name(Node node) const { return mNodes[node].mName; }
+
+private:
+  struct NodeData {
+    std::string mName;
+    Task mTask;
+    std::vector<Node> mSuccessors;
+    int mPredecessors = 0;
+  };
+
+  // Check the graph is acyclic and find the nodes that have no predecessors
+  void compile();
+
+  void spawn(ThreadPool& pool, Node node);
+  void runNode(ThreadPool& pool, Node node);
+
+  std::vector<NodeData> mNodes;
+  std::vector<Node> mSources;
+  bool mDirty = false;
+
+  // Predecessors that are yet to complete in the current submission
+  std::vector<std::atomic<int>> mRemaining;
+  // Handle returned by the last submission
+  ThreadPool::JobHandle mSubmission;
+  // The same handle, but only written from the root job itself so that nodes
+  // can read it without racing against submit()
+  ThreadPool::JobHandle mRoot;
+  ThreadPool::Priority mPriority = ThreadPool::Priority::Normal;
+};
+} // namespace selwonk
@@ -2,66 +2,670 @@
 
 #include <fmt/format.h>
 #include <fmt/ostream.h>
+#include <tracy/Tracy.hpp>
+
+#include "platform.hpp"
 
 namespace selwonk {
 
-ThreadPool::ThreadPool(unsigned int threadCount) {
+namespace {
+// The pool and queue owned by the current thread, if any
+struct ThreadContext {
+  ThreadPool* mPool = nullptr;
+  size_t mQueue = 0;
+  // The job being run by this thread, if any
+  ThreadPool::JobHandle mCurrentJob;
+  // Xorshift state for picking steal victims
+  uint32_t mRandom = 0;
+};
+thread_local ThreadContext tContext;
+
+uint32_t nextRandom() {
+  uint32_t x = tContext.mRandom;
+  if (x == 0) {
+    // Seed from the context's address, which differs per thread
+    x = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&tContext)) | 1;
+  }
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  tContext.mRandom = x;
+  return x;
+}
+
+// Pin the calling thread to a core based on its queue index, wrapping around if
+// there are more threads than cores
+void pinToCore(size_t queueIndex) {
+  unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+  auto core = static_cast<unsigned int>(queueIndex % cores);
+  if (!Platform::pinThread(core)) {
+    fmt::println("Failed to pin thread {} to core {}", queueIndex, core);
+  }
+}
+} // namespace
+
+ThreadPool::ThreadPool(unsigned int threadCount, bool pinThreads) {
+  // One queue for the owning thread, plus one per worker
+  for (unsigned int i = 0; i <= threadCount; i++) {
+    mQueues.emplace_back(std::make_unique<Lanes>());
+  }
+  mRecordCaches.resize(mQueues.size());
+  // Plus one for threads without a queue
+  mThreadStates = std::vector<ThreadState>(mQueues.size() + 1);
+  mWorkerStats.resize(mThreadStates.size());
+  tContext.mPool = this;
+  tContext.mQueue = OwnerQueue;
+  if (pinThreads)
+    pinToCore(OwnerQueue);
 
   fmt::println("Spawning {} worker threads", threadCount);
-  for (int i = 0; i < threadCount; i++) {
-    workerThreads.emplace_back(&ThreadPool::threadFunc, this);
+  for (unsigned int i = 0; i < threadCount; i++) {
+    mWorkerThreads.emplace_back(&ThreadPool::threadFunc, this, i + 1,
+                                pinThreads);
   }
 }
 
 ThreadPool::~ThreadPool() {
-  quitting = true;
-  jobsCv.notify_all();
-  for (auto& thread : workerThreads) {
+  mQuitting = true;
+  mWakeEpoch.fetch_add(1);
+  mWakeEpoch.notify_all();
+  for (auto& thread : mWorkerThreads) {
     thread.join();
   }
+
+  if (tContext.mPool == this) {
+    tContext.mPool = nullptr;
+  }
+  // Pending jobs are discarded along with mSlabs
+}
+
+ThreadPool::JobHandle ThreadPool::submit(JobRecord* record,
+                                         const JobOptions& options) {
+  assert(options.after.size() <= MaxDependencies &&
+         "Too many dependencies, consider using a TaskGraph");
+  mIncompleteJobs.fetch_add(1, std::memory_order_relaxed);
+
+  record->mPriority = options.priority;
+  record->mUnfinished.store(1, std::memory_order_relaxed);
+  // Hold the job back until all dependencies have been registered
+  record->mBlockers.store(1, std::memory_order_relaxed);
+  JobHandle handle(record, record->mGeneration.load(std::memory_order_relaxed));
+
+  if (options.parent.valid()) {
+    assert(!complete(options.parent) &&
+           "Cannot add a child to a completed job");
+    record->mParent = options.parent.mRecord;
+    record->mParent->mUnfinished.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  for (size_t i = 0; i < options.after.size(); i++) {
+    auto& dependency = options.after[i];
+    if (!dependency.valid())
+      continue;
+
+    JobRecord* other = dependency.mRecord;
+    other->lock();
+    // The dependency may have completed since the handle was created
+    if (other->mGeneration.load(std::memory_order_relaxed) ==
+        dependency.mGeneration) {
+      auto& node = record->mWaitNodes[i];
+      node = {.mJob = record, .mNext = other->mWaiters};
+      other->mWaiters = &node;
+      record->mBlockers.fetch_add(1, std::memory_order_relaxed);
+    }
+    other->unlock();
+  }
+
+  releaseBlocker(record);
+  return handle;
+}
+
+bool ThreadPool::complete(JobHandle handle) const {
+  if (!handle.valid())
+    return true;
+  return handle.mRecord->mGeneration.load(std::memory_order_acquire) !=
+         handle.mGeneration;
+}
+
+template <typename Done> void ThreadPool::helpUntil(Done done) {
+  while (!done()) {
+    if (auto* job = findJob(true)) {
+      runJob(job);
+      continue;
+    }
+
+    // Everything we could help with is in progress on other threads. Sleep
+    // until a job is added or completes, the same way workers do
+    auto idleSince = Clock::now();
+    uint32_t epoch = mWaiterEpoch.load(std::memory_order_relaxed);
+    mSleepingWaiters.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (done()) {
+      mSleepingWaiters.fetch_sub(1, std::memory_order_relaxed);
+      return;
+    }
+    if (auto* job = findJob(true)) {
+      mSleepingWaiters.fetch_sub(1, std::memory_order_relaxed);
+      runJob(job);
+      continue;
+    }
+    mWaiterEpoch.wait(epoch, std::memory_order_relaxed);
+    mSleepingWaiters.fetch_sub(1, std::memory_order_relaxed);
+    // Waiting inside a job already counts as busy
+    if (!currentJob().valid()) {
+      localState().mIdle.fetch_add((Clock::now() - idleSince).count(),
+                                   std::memory_order_relaxed);
+    }
+  }
+}
+
+void ThreadPool::await(JobHandle handle) {
+  helpUntil([&] { return complete(handle); });
+}
+
+void ThreadPool::helpUntilZero(std::atomic<size_t>& counter) {
+  helpUntil([&] { return counter.load(std::memory_order_acquire) == 0; });
+}
+
+void ThreadPool::countDown(std::atomic<size_t>& counter) {
+  if (counter.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    wakeWaiters();
+  }
+}
+
+ThreadPool* ThreadPool::current() { return tContext.mPool; }
+
+size_t ThreadPool::threadIndex() const {
+  if (tContext.mPool != this)
+    return NoThread;
+  return tContext.mQueue;
+}
+
+ThreadPool::JobHandle ThreadPool::currentJob() const {
+  if (tContext.mPool != this)
+    return {};
+  return tContext.mCurrentJob;
+}
+
+ThreadPool::Priority ThreadPool::currentPriority() const {
+  auto job = currentJob();
+  if (!job.valid())
+    return Priority::Normal;
+  // Safe to read, as the record can't be recycled while its job is running
+  return job.mRecord->mPriority;
+}
+
+void ThreadPool::beginFrame(Clock::duration backgroundBudget) {
+  mFrameStats = {};
+  for (size_t i = 0; i < mThreadStates.size(); i++) {
+    auto& state = mThreadStates[i];
+    auto& worker = mWorkerStats[i];
+    worker = {
+        .steals = state.mSteals.exchange(0, std::memory_order_relaxed),
+        .busy = Clock::duration(state.mBusy.exchange(
+            0, std::memory_order_relaxed)),
+        .idle = Clock::duration(state.mIdle.exchange(
+            0, std::memory_order_relaxed)),
+        .lockWait = Clock::duration(state.mLockWait.exchange(
+            0, std::memory_order_relaxed)),
+    };
+
+    for (size_t lane = 0; lane < PriorityCount; lane++) {
+      // Threads outside the pool share the shared queue
+      if (i < mQueues.size())
+        worker.queueDepth += (*mQueues[i])[lane].size();
+      else
+        worker.queueDepth += mSharedSize[lane].load(std::memory_order_relaxed);
+
+      auto& stats = state.mStats[lane];
+      auto& frame = mFrameStats[lane];
+      auto jobs = stats.mJobs.exchange(0, std::memory_order_relaxed);
+      worker.jobs += jobs;
+      frame.jobs += jobs;
+      frame.totalWait += Clock::duration(
+          stats.mTotalWait.exchange(0, std::memory_order_relaxed));
+      frame.waitBehindLower += Clock::duration(
+          stats.mWaitBehindLower.exchange(0, std::memory_order_relaxed));
+      frame.maxWait = std::max(frame.maxWait,
+                               Clock::duration(stats.mMaxWait.exchange(
+                                   0, std::memory_order_relaxed)));
+    }
+  }
+
+  mBackgroundBudget.store(backgroundBudget.count(), std::memory_order_relaxed);
+  // Background jobs left over from the previous frame may run now
+  if (mBackgroundQueued.load(std::memory_order_relaxed) > 0)
+    wakeAllWorkers();
+}
+
+ThreadPool::ThreadState& ThreadPool::localState() {
+  if (tContext.mPool != this)
+    return mThreadStates.back();
+  return mThreadStates[tContext.mQueue];
+}
+
+std::unique_lock<std::mutex> ThreadPool::lockTimed(std::mutex& mutex) {
+  // Only check the time when we actually have to wait
+  std::unique_lock lock(mutex, std::try_to_lock);
+  if (lock.owns_lock())
+    return lock;
+
+  auto start = Clock::now();
+  lock.lock();
+  localState().mLockWait.fetch_add((Clock::now() - start).count(),
+                                   std::memory_order_relaxed);
+  return lock;
+}
+
+bool ThreadPool::lowerPriorityRunning(Priority priority) {
+  switch (priority) {
+  case Priority::Critical:
+    // Critical jobs are comparatively rare, so can afford to check every thread
+    // The calling thread is busy adding this job, so doesn't count
+    for (auto& state : mThreadStates) {
+      if (&state != &localState() &&
+          state.mRunning.load(std::memory_order_relaxed) >
+          static_cast<int>(Priority::Critical))
+        return true;
+    }
+    return false;
+  case Priority::Normal:
+    // Normal jobs are the bulk of the work, stick to a single shared counter
+    // that only changes as often as background jobs do
+    return mBackgroundRunning.load(std::memory_order_relaxed) > 0;
+  case Priority::Background:
+    return false;
+  }
+  return false;
+}
+
+void ThreadPool::recordWait(JobRecord* record, Clock::time_point started) {
+  auto& stats = localState().mStats[static_cast<size_t>(record->mPriority)];
+  auto wait = (started - record->mQueuedAt).count();
+
+  // Each thread has its own stats, so these are uncontended
+  stats.mJobs.fetch_add(1, std::memory_order_relaxed);
+  stats.mTotalWait.fetch_add(wait, std::memory_order_relaxed);
+  if (record->mBehindLower)
+    stats.mWaitBehindLower.fetch_add(wait, std::memory_order_relaxed);
+
+  auto max = stats.mMaxWait.load(std::memory_order_relaxed);
+  while (wait > max && !stats.mMaxWait.compare_exchange_weak(
+                           max, wait, std::memory_order_relaxed)) {
+  }
+}
+
+ThreadPool::RecordCache* ThreadPool::localCache() {
+  if (tContext.mPool != this)
+    return nullptr;
+  return &mRecordCaches[tContext.mQueue];
+}
+
+ThreadPool::JobRecord* ThreadPool::allocateRecord() {
+  RecordCache* cache = localCache();
+  std::unique_lock<std::mutex> lock;
+  if (cache == nullptr) {
+    // Threads without a cache of their own share one
+    lock = lockTimed(mRecordsMtx);
+    cache = &mSharedCache;
+  }
+
+  if (cache->mHead == nullptr) {
+    if (!lock.owns_lock())
+      lock = lockTimed(mRecordsMtx);
+    refillCache(*cache);
+  }
+
+  JobRecord* record = cache->mHead;
+  cache->mHead = record->mNextFree;
+  cache->mCount--;
+  record->mNextFree = nullptr;
+  return record;
+}
+
+void ThreadPool::refillCache(RecordCache& cache) {
+  if (mFreeBatches != nullptr) {
+    JobRecord* batch = mFreeBatches;
+    mFreeBatches = batch->mNextBatch;
+    batch->mNextBatch = nullptr;
+    cache.mHead = batch;
+    cache.mCount = RecordBatchSize;
+    return;
+  }
+
+  if (&cache != &mSharedCache && mSharedCache.mHead != nullptr) {
+    cache = mSharedCache;
+    mSharedCache = {};
+    return;
+  }
+
+  // Nothing to recycle, allocate a new slab
+  cache.mHead = allocateSlab();
+  cache.mCount = SlabSize;
+}
+
+ThreadPool::JobRecord* ThreadPool::allocateSlab() {
+  auto slab = std::make_unique<JobRecord[]>(SlabSize);
+  for (size_t i = 0; i < SlabSize - 1; i++) {
+    slab[i].mNextFree = &slab[i + 1];
+  }
+  JobRecord* head = &slab[0];
+  mSlabs.emplace_back(std::move(slab));
+  return head;
+}
+
+void ThreadPool::reserve(size_t count) {
+  if (auto* lanes = localQueue()) {
+    for (auto& queue : *lanes) {
+      queue.reserve(count);
+    }
+  }
+
+  // Each thread may hold on to up to two batches without returning them
+  count += mRecordCaches.size() * RecordBatchSize * 2;
+
+  std::lock_guard lock(mRecordsMtx);
+  size_t available = mSlabs.size() * SlabSize;
+  while (available < count) {
+    // Split the slab into batches for any thread to take
+    JobRecord* head = allocateSlab();
+    for (size_t i = 0; i < SlabSize; i += RecordBatchSize) {
+      JobRecord* batch = head + i;
+      batch[RecordBatchSize - 1].mNextFree = nullptr;
+      batch->mNextBatch = mFreeBatches;
+      mFreeBatches = batch;
+    }
+    available += SlabSize;
+  }
+}
+
+void ThreadPool::freeRecord(JobRecord* record) {
+  record->mParent = nullptr;
+
+  RecordCache* cache = localCache();
+  std::unique_lock<std::mutex> lock;
+  if (cache == nullptr) {
+    lock = lockTimed(mRecordsMtx);
+    cache = &mSharedCache;
+  }
+
+  record->mNextFree = cache->mHead;
+  cache->mHead = record;
+  cache->mCount++;
+
+  // Records are often freed by a different thread to the one that allocated
+  // them. Hand surplus back so the allocating thread doesn't need a new slab
+  if (cache->mCount >= RecordBatchSize * 2) {
+    JobRecord* batch = cache->mHead;
+    JobRecord* last = batch;
+    for (size_t i = 1; i < RecordBatchSize; i++) {
+      last = last->mNextFree;
+    }
+    cache->mHead = last->mNextFree;
+    cache->mCount -= RecordBatchSize;
+    last->mNextFree = nullptr;
+
+    if (!lock.owns_lock())
+      lock = lockTimed(mRecordsMtx);
+    batch->mNextBatch = mFreeBatches;
+    mFreeBatches = batch;
+  }
+}
+
+void ThreadPool::schedule(JobRecord* record) {
+  // The record may be taken by another thread as soon as it is pushed, so
+  // must not be touched afterwards
+  auto priority = record->mPriority;
+  auto lane = static_cast<size_t>(priority);
+  record->mQueuedAt = Clock::now();
+  record->mBehindLower = lowerPriorityRunning(priority);
+
+  if (priority == Priority::Background) {
+    mBackgroundQueued.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if (auto* lanes = localQueue()) {
+    (*lanes)[lane].push(record);
+  } else {
+    auto lock = lockTimed(mSharedMtx);
+    mSharedJobs[lane].push_back(record);
+    mSharedSize[lane].store(mSharedJobs[lane].size(),
+                            std::memory_order_relaxed);
+  }
+
+  // No point waking anyone for a job they are not allowed to take
+  if (priority != Priority::Background ||
+      mBackgroundBudget.load(std::memory_order_relaxed) > 0) {
+    wakeWorker();
+  }
+  // Threads waiting on other jobs can run this one too. Without this, jobs
+  // added from outside the pool would never run if it has no idle workers
+  wakeWaiters();
+}
+
+void ThreadPool::releaseBlocker(JobRecord* record) {
+  if (record->mBlockers.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    schedule(record);
+  }
+}
+
+void ThreadPool::finishJob(JobRecord* record) {
+  if (record->mUnfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return; // Still waiting for children
+
+  JobRecord* parent = record->mParent;
+
+  // Invalidate handles and take the waiter list in one step, so that nobody
+  // can add themselves as a waiter after we've released them
+  record->lock();
+  auto* waiter = record->mWaiters;
+  record->mWaiters = nullptr;
+  record->mGeneration.fetch_add(1, std::memory_order_release);
+  record->unlock();
+
+  while (waiter != nullptr) {
+    // The waiter's record may be reused as soon as it is released, read
+    // everything we need first
+    auto* next = waiter->mNext;
+    releaseBlocker(waiter->mJob);
+    waiter = next;
+  }
+
+  freeRecord(record);
+  if (parent != nullptr) {
+    finishJob(parent);
+  }
+
+  mIncompleteJobs.fetch_sub(1, std::memory_order_acq_rel);
+  // Threads in await or awaitAll may be waiting on this job
+  wakeWaiters();
+}
+
+void ThreadPool::wakeWorker() {
+  // Pairs with the fence in threadFunc. Either the worker sees our job when it
+  // checks for work before sleeping, or we see that it is sleeping
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (mSleepingWorkers.load(std::memory_order_relaxed) > 0) {
+    mWakeEpoch.fetch_add(1, std::memory_order_relaxed);
+    mWakeEpoch.notify_one();
+  }
+}
+
+void ThreadPool::wakeWaiters() {
+  // Pairs with the fence in helpUntil, as with wakeWorker
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (mSleepingWaiters.load(std::memory_order_relaxed) > 0) {
+    mWaiterEpoch.fetch_add(1, std::memory_order_relaxed);
+    mWaiterEpoch.notify_all();
+  }
+}
+
+void ThreadPool::wakeAllWorkers() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (mSleepingWorkers.load(std::memory_order_relaxed) > 0) {
+    mWakeEpoch.fetch_add(1, std::memory_order_relaxed);
+    mWakeEpoch.notify_all();
+  }
 }
 
 void ThreadPool::awaitAll() {
-  std::unique_lock lock(jobsMtx);
-  jobsCv.wait(lock, [&] { return incompleteJobs == 0; });
+  helpUntil(
+      [this] { return mIncompleteJobs.load(std::memory_order_acquire) == 0; });
 }
 
-void ThreadPool::threadFunc() {
-  while (true) {
-    auto job = getJob();
-    if (job != nullptr) {
-      (*job)();
-      completeJob();
+void ThreadPool::threadFunc(size_t queueIndex, bool pin) {
+  tContext.mPool = this;
+  tContext.mQueue = queueIndex;
+  // Also names the thread for the OS, and therefore debuggers
+  tracy::SetThreadName(fmt::format("Worker {}", queueIndex).c_str());
+  if (pin)
+    pinToCore(queueIndex);
+
+  auto& state = localState();
+  // Start of the current idle period, if idleSpins > 0
+  Clock::time_point idleSince;
+  auto endIdle = [&] {
+    state.mIdle.fetch_add((Clock::now() - idleSince).count(),
+                          std::memory_order_relaxed);
+  };
+
+  int idleSpins = 0;
+  while (!mQuitting.load(std::memory_order_relaxed)) {
+    if (auto* job = findJob(false)) {
+      if (idleSpins > 0)
+        endIdle();
+      runJob(job);
+      idleSpins = 0;
+      continue;
+    }
+
+    if (idleSpins == 0)
+      idleSince = Clock::now();
+    if (++idleSpins < SpinCount) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    // Nothing to do, go to sleep until more jobs are added
+    uint32_t epoch = mWakeEpoch.load(std::memory_order_relaxed);
+    mSleepingWorkers.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Check once more, in case a job was added or the budget was reset before
+    // we were counted
+    if (auto* job = findJob(false)) {
+      mSleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+      endIdle();
+      runJob(job);
+      idleSpins = 0;
+    } else if (!mQuitting.load(std::memory_order_relaxed)) {
+      mWakeEpoch.wait(epoch, std::memory_order_relaxed);
+      mSleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+      // Still idle until we find a job, but spin again before sleeping
+      idleSpins = 1;
     } else {
-      fmt::println("Worker thread {} exiting",
-                   fmt::streamed(std::this_thread::get_id()));
-      return; // We are quitting
+      mSleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
     }
   }
-}
 
-std::unique_ptr<ThreadPool::Job> ThreadPool::getJob() {
-  std::unique_lock lock(jobsMtx);
-  jobsCv.wait(lock, [&] { return quitting || !jobs.empty(); });
+  fmt::println("Worker thread {} exiting",
+               fmt::streamed(std::this_thread::get_id()));
+}
 
-  if (quitting) {
+ThreadPool::Lanes* ThreadPool::localQueue() {
+  if (tContext.mPool != this)
     return nullptr;
+  return mQueues[tContext.mQueue].get();
+}
+
+ThreadPool::JobRecord* ThreadPool::findJob(bool ignoreBudget) {
+  for (size_t lane = 0; lane < PriorityCount; lane++) {
+    auto priority = static_cast<Priority>(lane);
+    if (priority == Priority::Background && !ignoreBudget &&
+        mBackgroundBudget.load(std::memory_order_relaxed) <= 0)
+      break;
+
+    if (auto* job = findJob(priority)) {
+      if (priority == Priority::Background)
+        mBackgroundQueued.fetch_sub(1, std::memory_order_relaxed);
+      return job;
+    }
+  }
+  return nullptr;
+}
+
+ThreadPool::JobRecord* ThreadPool::findJob(Priority priority) {
+  auto lane = static_cast<size_t>(priority);
+  if (auto* lanes = localQueue()) {
+    if (auto job = (*lanes)[lane].pop())
+      return *job;
+  }
+
+  if (mSharedSize[lane].load(std::memory_order_relaxed) > 0) {
+    auto lock = lockTimed(mSharedMtx);
+    auto& jobs = mSharedJobs[lane];
+    if (!jobs.empty()) {
+      auto* job = jobs.back();
+      jobs.pop_back();
+      mSharedSize[lane].store(jobs.size(), std::memory_order_relaxed);
+      return job;
+    }
   }
 
-  auto j = std::move(jobs.back());
-  jobs.pop_back();
-  return j;
+  return stealJob(priority);
 }
 
-void ThreadPool::completeJob() {
-  {
-    std::lock_guard lock(jobsMtx);
-    incompleteJobs--;
+ThreadPool::JobRecord* ThreadPool::stealJob(Priority priority) {
+  // Start from a random victim so thieves spread out rather than all hammering
+  // the same queue
+  auto lane = static_cast<size_t>(priority);
+  size_t count = mQueues.size();
+  size_t start = nextRandom() % count;
+  auto* local = localQueue();
+  for (size_t i = 0; i < count; i++) {
+    auto& victim = mQueues[(start + i) % count];
+    if (victim.get() == local)
+      continue;
+    if (auto job = (*victim)[lane].steal()) {
+      localState().mSteals.fetch_add(1, std::memory_order_relaxed);
+      return *job;
+    }
   }
-  // Let the main thread know something's changed
-  // notify_one cannot be used as it could be consumed by
-  // a worker without anything to do, and would not fall back
-  jobsCv.notify_all();
+  return nullptr;
+}
+
+void ThreadPool::runJob(JobRecord* record) {
+  // Jobs may await others, which runs jobs on this thread recursively
+  auto previous = tContext.mCurrentJob;
+  tContext.mCurrentJob =
+      JobHandle(record, record->mGeneration.load(std::memory_order_relaxed));
+
+  auto& state = localState();
+  int previousPriority = state.mRunning.load(std::memory_order_relaxed);
+  state.mRunning.store(static_cast<int>(record->mPriority),
+                       std::memory_order_relaxed);
+  bool background = record->mPriority == Priority::Background;
+  if (background)
+    mBackgroundRunning.fetch_add(1, std::memory_order_relaxed);
+
+  auto started = Clock::now();
+  recordWait(record, started);
+
+  record->mFunc();
+  // Release captures now, rather than when the record is reused
+  record->mFunc.reset();
+
+  auto elapsed = (Clock::now() - started).count();
+  // Jobs run while this one waited are already part of its time
+  if (!previous.valid())
+    state.mBusy.fetch_add(elapsed, std::memory_order_relaxed);
+  if (background) {
+    mBackgroundBudget.fetch_sub(elapsed, std::memory_order_relaxed);
+    mBackgroundRunning.fetch_sub(1, std::memory_order_relaxed);
+  }
+  state.mRunning.store(previousPriority, std::memory_order_relaxed);
+
+  tContext.mCurrentJob = previous;
+  finishJob(record);
 }
 
 } // namespace selwonk
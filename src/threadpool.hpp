@@ -1,61 +1,501 @@
 #pragma once
 
-#include <condition_variable>
-#include <functional>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <mutex>
+#include <span>
 #include <thread>
 #include <vector>
 
+#include "core/inlinefunction.hpp"
+#include "core/stealqueue.hpp"
+
 namespace selwonk {
 
-// Basic thread pool for running short-lived tasks in parallel
-// Order of operations is not specified, do not use for time-sensitive actions
-// There are no means for prioritizing jobs, cancelling jobs, or waiting for a
-// specific job to complete. None of these were needed for the original use case
-// (part of a resource manager class)
+// Work-stealing thread pool for running short-lived tasks in parallel
+// Order of operations is not specified beyond declared dependencies and
+// priorities. There are no means for cancelling jobs
+//
+// A number of worker threads are allocated according to threadCount. Each
+// worker, as well as the thread that created the pool, owns a lock-free queue
+// that it pushes new jobs to and runs them from. Workers that run out of jobs
+// steal from the other queues before going to sleep. Jobs added from any other
+// thread go through a shared queue
+//
+// Every job returns a handle that can be awaited or used as a dependency of
+// later jobs. A job may also be given a parent, which will not be considered
+// complete until all of its children are. For a set of jobs that is run
+// repeatedly, see TaskGraph
+//
+// Adding a job does not allocate in the steady state. Captures are stored
+// inline in pooled job records, which are cached per-thread and recycled in
+// batches. Jobs that capture more than InlineJobSize bytes must be added with
+// addLargeJob, which boxes the callable on the heap
 //
-// A number of worker threads are allocated according to threadCount
+// Jobs are split into priority lanes, and a thread always takes the most urgent
+// job available. Background jobs are additionally limited to a time budget per
+// frame, see beginFrame
 //
 // If destroyed while jobs are still pending, they will be discarded
 class ThreadPool {
+protected:
+  struct JobRecord;
+
 public:
-  using Job = std::function<void()>;
+  // Maximum number of jobs that a single job may run after
+  const static constexpr size_t MaxDependencies = 8;
+  // Maximum size of a job's captures
+  const static constexpr size_t InlineJobSize = 64;
+  using InlineJob = core::InlineFunction<InlineJobSize>;
+  using Clock = std::chrono::steady_clock;
+
+  // Lanes that jobs are queued in, from most to least urgent. Jobs are not
+  // preempted, so a long job in any lane will still occupy its thread
+  enum class Priority : uint8_t {
+    // Work the current frame is waiting on, such as culling or command
+    // recording
+    Critical,
+    // General work, the default
+    Normal,
+    // Long-running work that may span several frames, such as streaming
+    // assets. Limited by the per-frame budget
+    Background,
+  };
+  const static constexpr size_t PriorityCount = 3;
+
+  // Reference to a job that has been added to the pool. Remains safe to use
+  // after the job completes, but not after the pool is destroyed
+  class JobHandle {
+  public:
+    JobHandle() = default;
+    bool valid() const { return mRecord != nullptr; }
+
+  private:
+    friend class ThreadPool;
+    JobHandle(JobRecord* record, uint32_t generation)
+        : mRecord(record), mGeneration(generation) {}
+
+    JobRecord* mRecord = nullptr;
+    uint32_t mGeneration = 0;
+  };
+
+  struct JobOptions {
+    // Jobs that must complete before this one starts. Invalid handles and
+    // completed jobs are ignored
+    std::span<const JobHandle> after = {};
+    // Job that will not complete until this one has. The parent must not have
+    // completed yet, usually it is the job that is adding this one. See
+    // currentJob()
+    JobHandle parent = {};
+    // Lane to queue the job in. Not inherited from the parent
+    Priority priority = Priority::Normal;
+  };
+
+  // Time spent by jobs of a single priority between becoming ready to run and
+  // being started
+  struct WaitStats {
+    size_t jobs = 0;
+    Clock::duration totalWait = {};
+    Clock::duration maxWait = {};
+    // Portion of totalWait spent by jobs that were queued while a lower
+    // priority job was occupying a thread
+    Clock::duration waitBehindLower = {};
+
+    Clock::duration averageWait() const {
+      if (jobs == 0)
+        return {};
+      return totalWait / static_cast<Clock::rep>(jobs);
+    }
+  };
+
+  // Activity of a single thread over a frame
+  struct WorkerStats {
+    // Jobs run, including those run while waiting on another job
+    size_t jobs = 0;
+    // Jobs taken from other threads' queues
+    size_t steals = 0;
+    // Time spent running jobs
+    Clock::duration busy = {};
+    // Time spent looking for jobs, or asleep waiting for them
+    Clock::duration idle = {};
+    // Time spent blocked on the pool's mutexes
+    Clock::duration lockWait = {};
+    // Jobs in the thread's queue when the frame ended
+    size_t queueDepth = 0;
+  };
 
-  ThreadPool(unsigned int threadCount);
+  // Worker threads are named for debuggers and profilers. If `pinThreads` is
+  // set, each thread, including the calling one, is pinned to a CPU core of its
+  // own where possible
+  ThreadPool(unsigned int threadCount, bool pinThreads = false);
   ~ThreadPool();
 
-  // Wait for all jobs to complete. Be weary of deadlocks
+  // Wait for all jobs to complete. The calling thread runs jobs while it
+  // waits, rather than sleeping. Be weary of deadlocks
   void awaitAll();
 
-  void addJob(std::unique_ptr<Job> job) {
-    {
-      std::lock_guard lock(jobsMtx);
-      jobs.push_back(std::move(job));
-      incompleteJobs++;
+  template <typename F>
+  JobHandle addJob(F&& func, const JobOptions& options) {
+    static_assert(InlineJob::fits<F>,
+                  "Job captures are too large to store inline. Capture less, "
+                  "or use addLargeJob");
+    JobRecord* record = allocateRecord();
+    record->mFunc.emplace(std::forward<F>(func));
+    return submit(record, options);
+  }
+  template <typename F> JobHandle addJob(F&& func) {
+    return addJob(std::forward<F>(func), JobOptions{});
+  }
+
+  // Add a job whose captures do not fit inline. Allocates, so should be
+  // avoided on hot paths
+  template <typename F>
+  JobHandle addLargeJob(F&& func, const JobOptions& options) {
+    auto boxed = std::make_unique<std::decay_t<F>>(std::forward<F>(func));
+    return addJob([boxed = std::move(boxed)] { (*boxed)(); }, options);
+  }
+  template <typename F> JobHandle addLargeJob(F&& func) {
+    return addLargeJob(std::forward<F>(func), JobOptions{});
+  }
+
+  // Has the job, and all of its children, completed?
+  bool complete(JobHandle handle) const;
+  // Wait for a job and all of its children to complete, running other jobs in
+  // the meantime. An invalid handle is considered complete
+  void await(JobHandle handle);
+
+  // Get the job currently running on this thread, or an invalid handle if
+  // called outside of a job
+  JobHandle currentJob() const;
+
+  // Get the pool that the calling thread belongs to, either as a worker or as
+  // the owner, or nullptr if it belongs to none
+  static ThreadPool* current();
+
+  // Run jobs until counter reaches zero. The counter must only be decremented
+  // through countDown, which wakes the waiting thread
+  void helpUntilZero(std::atomic<size_t>& counter);
+  // Decrement a counter being waited on by helpUntilZero. The counter may be
+  // destroyed as soon as it reaches zero, so is not touched afterwards
+  void countDown(std::atomic<size_t>& counter);
+
+  // Preallocate space for at least `count` jobs in flight at once, so that
+  // adding them from this thread never allocates, even while the pool is
+  // warming up
+  void reserve(size_t count);
+
+  // Number of threads that may run jobs, including the owning thread
+  unsigned int concurrency() const { return mQueues.size(); }
+
+  // Start a new frame, allowing background jobs to run for up to
+  // `backgroundBudget` of thread time in total until the next call. A job that
+  // is already running is never interrupted, so the budget may be overrun by up
+  // to one job per thread
+  // Until this is first called, background jobs are not limited. Threads that
+  // are waiting for jobs to complete ignore the budget, as they would
+  // otherwise deadlock
+  // Also collects wait and worker stats for the frame that just ended. Owning
+  // thread only
+  void beginFrame(Clock::duration backgroundBudget);
+  // Get wait stats collected over the previous frame
+  const WaitStats& frameStats(Priority priority) const {
+    return mFrameStats[static_cast<size_t>(priority)];
+  }
+  // Get per-thread stats collected over the previous frame. The owning thread
+  // comes first, followed by each worker, then a final entry shared by every
+  // thread outside the pool
+  std::span<const WorkerStats> workerStats() const { return mWorkerStats; }
+
+  // Priority of the job currently running on this thread, or Normal if called
+  // outside of a job
+  Priority currentPriority() const;
+
+  // Half-open range of indices [begin, end)
+  struct Range {
+    size_t begin;
+    size_t end;
+    size_t size() const { return end - begin; }
+  };
+
+  // Call func(index) for every index in the range, in parallel. The calling
+  // thread takes part, and returns once every index has been processed
+  // The range is split in half a few times up front, and further only when an
+  // idle thread steals a chunk. Chunks are never split below grainSize
+  template <typename F>
+  void parallelFor(Range range, size_t grainSize, F&& func) {
+    forEachChunk(range, grainSize, [&func](Range chunk) {
+      for (size_t i = chunk.begin; i < chunk.end; i++) {
+        func(i);
+      }
+    });
+  }
+
+  // Reduce a range in parallel, split the same way as parallelFor. Each chunk
+  // starts from `identity` and folds in its indices with
+  // `func(accumulator, index) -> T`. Results from each chunk are merged with
+  // `combine(T, T) -> T`, which must be associative and commutative as chunks
+  // may finish in any order
+  template <typename T, typename F, typename C>
+  T parallelReduce(Range range, size_t grainSize, T identity, F&& func,
+                   C&& combine) {
+    T total = identity;
+    std::mutex totalMtx;
+    forEachChunk(range, grainSize, [&](Range chunk) {
+      T partial = identity;
+      for (size_t i = chunk.begin; i < chunk.end; i++) {
+        partial = func(std::move(partial), i);
+      }
+      std::lock_guard lock(totalMtx);
+      total = combine(std::move(total), std::move(partial));
+    });
+    return total;
+  }
+
+  // Call func(chunk) for non-overlapping chunks that together cover the range,
+  // in parallel. Building block for parallelFor and parallelReduce, useful
+  // directly when per-chunk setup is expensive
+  template <typename F>
+  void forEachChunk(Range range, size_t grainSize, F&& func) {
+    grainSize = std::max<size_t>(grainSize, 1);
+    if (range.size() == 0)
+      return;
+    if (range.size() <= grainSize || concurrency() == 1) {
+      func(range);
+      return;
     }
-    // Wake up a worker thread to complete the job
-    jobsCv.notify_one();
+
+    LoopState<std::remove_reference_t<F>> state{.mFunc = func,
+                                                .mGrainSize = grainSize};
+    // Aim for a few chunks per thread to start with
+    unsigned int depth = std::bit_width(concurrency()) + 1;
+    splitChunk(state, range, depth);
+    helpUntilZero(state.mPending);
   }
 
 protected:
-  bool quitting = false;
-  std::vector<std::thread> workerThreads;
-  std::vector<std::unique_ptr<Job>> jobs;
-  // This is NOT the same as jobs.size(), as the latter includes jobs
-  // that have been accepted, but are yet to complete
-  int incompleteJobs = 0;
-  std::mutex jobsMtx;
-  std::condition_variable jobsCv;
+  // Index of the owning thread's queue, workers follow it
+  const static constexpr size_t OwnerQueue = 0;
+  // Number of times to look for work before going to sleep
+  const static constexpr int SpinCount = 64;
+  // Returned by threadIndex() for threads outside the pool
+  const static constexpr size_t NoThread = SIZE_MAX;
+  // Stored in ThreadState::mRunning while not running a job
+  const static constexpr int NotRunning = -1;
+  // Minimum number of times a stolen chunk may be split again
+  const static constexpr unsigned int StealSplitDepth = 2;
+  // Number of job records allocated at once
+  const static constexpr size_t SlabSize = 256;
+  // Number of job records moved between threads at once
+  const static constexpr size_t RecordBatchSize = 64;
+  static_assert(SlabSize % RecordBatchSize == 0,
+                "Slabs must split evenly into batches");
+
+  struct JobRecord {
+    // Entry in the waiter list of a job that this one runs after
+    struct Waiter {
+      JobRecord* mJob;
+      Waiter* mNext;
+    };
+
+    InlineJob mFunc;
+    JobRecord* mParent = nullptr;
+    Priority mPriority = Priority::Normal;
+    // Set when a lower priority job was running when this one was queued
+    bool mBehindLower = false;
+    Clock::time_point mQueuedAt;
+    // This job, plus any incomplete children
+    std::atomic<int> mUnfinished = 0;
+    // Incomplete dependencies, plus one while they are being registered
+    std::atomic<int> mBlockers = 0;
+
+    // Incremented when the job completes, invalidating any handles to it
+    std::atomic<uint32_t> mGeneration = 0;
+    // Guards mWaiters and completion, as another thread may be trying to add
+    // itself as a waiter
+    std::atomic_flag mLock;
+    // Jobs waiting for this one to complete
+    Waiter* mWaiters = nullptr;
+    // Storage for our own entries in other jobs' waiter lists
+    std::array<Waiter, MaxDependencies> mWaitNodes;
+
+    // Next record in a free list, while not in use
+    JobRecord* mNextFree = nullptr;
+    // Next batch in the shared free list, while heading a batch
+    JobRecord* mNextBatch = nullptr;
+
+    void lock() {
+      while (mLock.test_and_set(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+    }
+    void unlock() { mLock.clear(std::memory_order_release); }
+  };
+
+  std::atomic<bool> mQuitting = false;
+  std::vector<std::thread> mWorkerThreads;
+  // One queue per lane
+  using Lanes = std::array<core::StealQueue<JobRecord*>, PriorityCount>;
+  std::vector<std::unique_ptr<Lanes>> mQueues;
+
+  // Jobs added from threads that do not own a queue
+  std::mutex mSharedMtx;
+  std::array<std::vector<JobRecord*>, PriorityCount> mSharedJobs;
+  std::array<std::atomic<size_t>, PriorityCount> mSharedSize = {};
+
+  // Remaining thread time that background jobs may use this frame
+  std::atomic<Clock::rep> mBackgroundBudget = Clock::duration::max().count();
+  // Background jobs that are ready to run, and that are running
+  std::atomic<int> mBackgroundQueued = 0;
+  std::atomic<int> mBackgroundRunning = 0;
+
+  struct LaneStats {
+    std::atomic<size_t> mJobs = 0;
+    std::atomic<Clock::rep> mTotalWait = 0;
+    std::atomic<Clock::rep> mMaxWait = 0;
+    std::atomic<Clock::rep> mWaitBehindLower = 0;
+  };
+  // State written by a single thread during a frame, and read by others
+  // Threads that do not own a queue share the final entry
+  struct alignas(64) ThreadState {
+    // Priority of the job being run, or NotRunning
+    std::atomic<int> mRunning = NotRunning;
+    std::array<LaneStats, PriorityCount> mStats;
+    std::atomic<size_t> mSteals = 0;
+    std::atomic<Clock::rep> mBusy = 0;
+    std::atomic<Clock::rep> mIdle = 0;
+    std::atomic<Clock::rep> mLockWait = 0;
+  };
+  std::vector<ThreadState> mThreadStates;
+  // Stats collected by the last beginFrame
+  std::array<WaitStats, PriorityCount> mFrameStats;
+  std::vector<WorkerStats> mWorkerStats;
+
+  // Free records owned by a single thread
+  struct alignas(64) RecordCache {
+    JobRecord* mHead = nullptr;
+    size_t mCount = 0;
+  };
+  // Indexed the same as mQueues
+  std::vector<RecordCache> mRecordCaches;
+
+  // Every record ever allocated, in slabs of SlabSize. Records are never freed
+  // while the pool exists, so that stale handles can safely check their
+  // generation
+  std::mutex mRecordsMtx;
+  std::vector<std::unique_ptr<JobRecord[]>> mSlabs;
+  // Batches of RecordBatchSize free records, returned by threads that had a
+  // surplus
+  JobRecord* mFreeBatches = nullptr;
+  // Cache for threads that do not own a queue
+  RecordCache mSharedCache;
+
+  // Jobs that have been added, but are yet to complete
+  std::atomic<int> mIncompleteJobs = 0;
+  // Incremented to wake sleeping workers when new jobs are added
+  std::atomic<uint32_t> mWakeEpoch = 0;
+  // Incremented to wake threads waiting in await, awaitAll, or helpUntilZero
+  // when jobs are added or complete. Waiters sleep on this rather than what
+  // they are waiting for, so that new jobs can wake them and so that counters
+  // may live on a stack that is gone by the time we would notify them
+  std::atomic<uint32_t> mWaiterEpoch = 0;
+  std::atomic<int> mSleepingWaiters = 0;
+  std::atomic<int> mSleepingWorkers = 0;
 
   // Entry point for worker threads
   // Fetch and execute jobs until exit
-  void threadFunc();
+  void threadFunc(size_t queueIndex, bool pin);
+
+  // Get the queues owned by the calling thread, or nullptr if it does not own
+  // any
+  Lanes* localQueue();
+  ThreadState& localState();
+  // Lock a mutex, counting any time spent blocked as lock wait
+  std::unique_lock<std::mutex> lockTimed(std::mutex& mutex);
+
+  // Take a job from the local queue, the shared queue, or another thread's
+  // queue in that order, from the most urgent lane that has one. Background
+  // jobs are skipped once the frame's budget has been used, unless
+  // `ignoreBudget` is set. Returns nullptr if no jobs are available
+  JobRecord* findJob(bool ignoreBudget);
+  JobRecord* findJob(Priority priority);
+  JobRecord* stealJob(Priority priority);
+
+  JobRecord* allocateRecord();
+  void freeRecord(JobRecord* record);
+  // Get the calling thread's record cache, or nullptr if it has none
+  RecordCache* localCache();
+  // Fill an empty cache from the shared lists, or allocate a new slab. Must
+  // hold mRecordsMtx
+  void refillCache(RecordCache& cache);
+  // Allocate a slab of records, linked into a single free list. Must hold
+  // mRecordsMtx
+  JobRecord* allocateSlab();
+
+  // Make a newly filled record visible to the pool
+  JobHandle submit(JobRecord* record, const JobOptions& options);
 
-  // Get a job once one is ready, or return nullptr when quitting
-  std::unique_ptr<Job> getJob();
+  // Queue a job whose dependencies have all completed
+  void schedule(JobRecord* record);
+  // Called when one of a job's dependencies completes
+  void releaseBlocker(JobRecord* record);
+  // Called when a job or one of its children finishes
+  void finishJob(JobRecord* record);
+
+  // Wake a sleeping worker, if there is one
+  void wakeWorker();
+  // Wake every sleeping worker
+  void wakeAllWorkers();
+  // Wake every thread sleeping in helpUntil
+  void wakeWaiters();
+  // Run jobs until done() returns true, sleeping when there are none
+  template <typename Done> void helpUntil(Done done);
+  // Would a lower priority job occupying a thread delay a job of `priority`?
+  bool lowerPriorityRunning(Priority priority);
+  void recordWait(JobRecord* record, Clock::time_point started);
+
+  // Get the index of the calling thread's queue, or NoThread
+  size_t threadIndex() const;
+
+  template <typename F> struct LoopState {
+    F& mFunc;
+    size_t mGrainSize;
+    // Chunks handed to other jobs that are yet to finish
+    std::atomic<size_t> mPending = 0;
+  };
+
+  // Split off the right half of the range as a new job up to `depth` times,
+  // then process what is left
+  template <typename F>
+  void splitChunk(LoopState<F>& state, Range range, unsigned int depth) {
+    while (range.size() > state.mGrainSize && depth > 0) {
+      depth--;
+      size_t middle = range.begin + range.size() / 2;
+      Range right = {middle, range.end};
+      range.end = middle;
+
+      state.mPending.fetch_add(1, std::memory_order_relaxed);
+      size_t spawner = threadIndex();
+      auto job = [this, &state, right, depth, spawner] {
+        // Being stolen means another thread ran out of work, let it split
+        // further so that others can steal from it in turn
+        unsigned int newDepth = depth;
+        if (threadIndex() != spawner)
+          newDepth = std::max(depth, StealSplitDepth);
+        splitChunk(state, right, newDepth);
+        countDown(state.mPending);
+      };
+      // Chunks are as urgent as the loop they belong to
+      addJob(job, {.priority = currentPriority()});
+    }
+    state.mFunc(range);
+  }
 
-  // Callback for when a job is completed
-  void completeJob();
+  void runJob(JobRecord* record);
 };
 
 } // namespace selwonk
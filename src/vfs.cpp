@@ -5,6 +5,19 @@ namespace selwonk {
 const std::filesystem::path Vfs::Shaders = "shaders";
 const std::filesystem::path Vfs::Meshes = "meshes";
 
+Vfs::Vfs(Providers providers) : mProviders(std::move(providers)) {
+  mIoThread = std::thread(&Vfs::ioThreadFunc, this);
+}
+
+Vfs::~Vfs() {
+  {
+    std::lock_guard lock(mIoMtx);
+    mIoQuitting = true;
+  }
+  mIoCv.notify_one();
+  mIoThread.join();
+}
+
 std::ifstream Vfs::open(Path& path) {
   for (auto& provider : mProviders) {
     if (auto file = provider->open(path)) {
@@ -24,4 +37,54 @@ void Vfs::readfull(Path path, std::vector<std::byte>& buffer) {
   file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
 }
 
+void Vfs::ReadOperation::await_suspend(std::coroutine_handle<> handle) {
+  mHandle = handle;
+  mContext = ResumeContext::capture();
+
+  // We may be resumed and destroyed as soon as we're queued, don't touch any
+  // members afterwards
+  Vfs& vfs = mVfs;
+  {
+    std::lock_guard lock(vfs.mIoMtx);
+    if (vfs.mIoTail != nullptr)
+      vfs.mIoTail->mNext = this;
+    else
+      vfs.mIoHead = this;
+    vfs.mIoTail = this;
+  }
+  vfs.mIoCv.notify_one();
+}
+
+void Vfs::ReadOperation::await_resume() {
+  if (mError)
+    std::rethrow_exception(mError);
+}
+
+void Vfs::ioThreadFunc() {
+  while (true) {
+    ReadOperation* op;
+    {
+      std::unique_lock lock(mIoMtx);
+      mIoCv.wait(lock, [this] { return mIoHead != nullptr || mIoQuitting; });
+      // Finish outstanding reads before quitting, as coroutines are waiting
+      // on them
+      if (mIoHead == nullptr)
+        return;
+
+      op = mIoHead;
+      mIoHead = op->mNext;
+      if (mIoHead == nullptr)
+        mIoTail = nullptr;
+    }
+
+    try {
+      readfull(op->mPath, op->mBuffer);
+    } catch (...) {
+      op->mError = std::current_exception();
+    }
+    // The operation may be destroyed as soon as its coroutine resumes
+    op->mContext.resume(op->mHandle);
+  }
+}
+
 } // namespace selwonk
@@ -1,9 +1,16 @@
 #pragma once
 
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
 #include <filesystem>
 #include <fstream>
+#include <mutex>
+#include <thread>
 #include <vector>
 
+#include "task.hpp"
+
 namespace selwonk {
 // Very basic VFS implementation. Absolutely will not scale to many providers
 // and probably will need refactoring for different provider types (i.e., zip)
@@ -38,12 +45,53 @@ public:
   const static std::filesystem::path Shaders;
   const static std::filesystem::path Meshes;
 
-  Vfs(Providers providers) : mProviders(std::move(providers)) {}
+  // Read of an entire file, to be co_awaited. See readAsync
+  class [[nodiscard]] ReadOperation {
+  public:
+    bool await_ready() noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+    // Rethrows any error from the read
+    void await_resume();
+
+  private:
+    friend class Vfs;
+    ReadOperation(Vfs& vfs, Path path, std::vector<std::byte>& buffer)
+        : mVfs(vfs), mPath(path), mBuffer(buffer) {}
+
+    Vfs& mVfs;
+    std::filesystem::path mPath;
+    std::vector<std::byte>& mBuffer;
+    ResumeContext mContext;
+    std::coroutine_handle<> mHandle;
+    std::exception_ptr mError;
+    // Next operation in the I/O queue
+    ReadOperation* mNext = nullptr;
+  };
+
+  Vfs(Providers providers);
+  ~Vfs();
 
   std::ifstream open(Path path);
   void readfull(Path path, std::vector<std::byte>& buffer);
+  // Read an entire file on the I/O thread. The awaiting coroutine is
+  // suspended rather than blocked, and resumed once the read completes
+  ReadOperation readAsync(Path path, std::vector<std::byte>& buffer) {
+    return ReadOperation(*this, path, buffer);
+  }
 
 private:
+  // Entry point for the I/O thread. Perform reads until exit
+  void ioThreadFunc();
+
   Providers mProviders;
+
+  // Reads waiting for the I/O thread, oldest first. Operations live in the
+  // awaiting coroutine's frame, so queueing them doesn't allocate
+  std::mutex mIoMtx;
+  std::condition_variable mIoCv;
+  ReadOperation* mIoHead = nullptr;
+  ReadOperation* mIoTail = nullptr;
+  bool mIoQuitting = false;
+  std::thread mIoThread;
 };
 } // namespace selwonk
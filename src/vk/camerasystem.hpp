@@ -4,10 +4,15 @@
 #include "../core/window.hpp"
 #include "../ecs/entity.hpp"
 #include "../ecs/system.hpp"
+#include "../ecs/transform.hpp"
 
 // TODO: This shouldn't be part of vulkan
 namespace selwonk::vulkan {
-class CameraSystem : public ecs::System {
+// Writes the camera's transform through commands, and uses the window so must
+// run on the main thread
+class CameraSystem
+    : public ecs::TypedSystem<ecs::Reads<ecs::Transform>,
+                              ecs::Writes<ecs::Transform>, /*MainThread=*/true> {
 public:
   CameraSystem(ecs::EntityRef camera, const core::Keyboard& keyboard,
                core::Window& window)
@@ -8,6 +8,9 @@
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtc/constants.hpp>
 
+#include <algorithm>
+#include <cstring>
+
 namespace selwonk::vulkan {
 
 Debug::Debug() {
@@ -51,13 +54,23 @@ void Debug::initPipelines() {
 
 Debug::~Debug() {}
 
-void Debug::reset() {
-  mAllocator->reset();
-  mDebugMeshes.clear();
-  mLineCount = 0;
+void Debug::takeFrame(Frame& frame) {
+  frame.clear();
+  std::swap(frame, mPending);
 }
 
-void Debug::draw(vk::CommandBuffer cmd, vk::DescriptorSet drawDescriptors) {
+void Debug::draw(vk::CommandBuffer cmd, vk::DescriptorSet drawDescriptors,
+                 std::span<const vk::DescriptorSet> staticDescriptors,
+                 const Frame& frame) {
+  auto vertexCount =
+      std::min(frame.mLineVertices.size(), MaxDebugLines * 2);
+  mAllocator->reset();
+  if (vertexCount > 0) {
+    std::memcpy(mAllocator->allocate(vertexCount * sizeof(interop::Vertex)),
+                frame.mLineVertices.data(),
+                vertexCount * sizeof(interop::Vertex));
+  }
+
   cmd.bindPipeline(vk::PipelineBindPoint::eGraphics,
                    mSolidPipeline.getPipeline());
   cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
@@ -67,7 +80,7 @@ void Debug::draw(vk::CommandBuffer cmd, vk::DescriptorSet drawDescriptors) {
                          /*dynamicOffsetCount=*/0,
                          /*pDynamicOffsets=*/nullptr);
 
-  for (auto& mesh : mDebugMeshes) {
+  for (auto& mesh : frame.mMeshes) {
     for (auto& surface : mesh.mesh.mSurfaces) {
       interop::VertexPushConstants meshPushConstants = {
           .modelMatrix = mesh.transform,
@@ -95,10 +108,6 @@ void Debug::draw(vk::CommandBuffer cmd, vk::DescriptorSet drawDescriptors) {
   cmd.pushConstants(mPipeline.getLayout(), vk::ShaderStageFlagBits::eVertex, 0,
                     sizeof(interop::VertexPushConstants), &pushConstants);
 
-  auto& mEngine = VulkanEngine::get();
-  auto& frameData = mEngine.getCurrentFrame();
-  auto staticDescriptors = mEngine.getStaticDescriptors(frameData);
-
   cmd.bindDescriptorSets(
       vk::PipelineBindPoint::eGraphics, mPipeline.getLayout(),
       /*firstSet=*/0,
@@ -106,18 +115,16 @@ void Debug::draw(vk::CommandBuffer cmd, vk::DescriptorSet drawDescriptors) {
       /*dynamicOffsetCount=*/0,
       /*pDynamicOffsets=*/nullptr);
 
-  cmd.draw(mLineCount * 2, /*instanceCount=*/1,
+  cmd.draw(vertexCount, /*instanceCount=*/1,
            /*firstVertex=*/0,
            /*firstInstance=*/0);
 }
 
 void Debug::drawLine(const DebugLine& line) {
-  mAllocator->allocate(interop::Vertex{.position = glm::vec4(line.start, 1.0f),
-                                       .color = line.color});
-  mAllocator->allocate(interop::Vertex{.position = glm::vec4(line.end, 1.0f),
-                                       .color = line.color});
-
-  mLineCount++;
+  mPending.mLineVertices.push_back(
+      {.position = glm::vec4(line.start, 1.0f), .color = line.color});
+  mPending.mLineVertices.push_back(
+      {.position = glm::vec4(line.end, 1.0f), .color = line.color});
 }
 
 void Debug::drawBox(glm::vec3 origin, glm::vec3 halfExtent, glm::vec4 color) {
@@ -10,6 +10,9 @@
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 
+#include <span>
+#include <vector>
+
 namespace selwonk::vulkan {
 class Debug : public core::Singleton<Debug> {
 public:
@@ -26,6 +29,17 @@ public:
     glm::mat4 transform;
     const Mesh& mesh;
   };
+  // Geometry drawn during a frame, handed to the render thread in its
+  // RenderList so that the next frame can be drawn in the meantime
+  struct Frame {
+    std::vector<interop::Vertex> mLineVertices;
+    std::vector<DebugMesh> mMeshes;
+
+    void clear() {
+      mLineVertices.clear();
+      mMeshes.clear();
+    }
+  };
 
   const static constexpr glm::vec4 Red{1, 0, 0, 1};
   const static constexpr glm::vec4 Green{0, 1, 0, 1};
@@ -34,29 +48,36 @@ public:
   Debug();
   ~Debug();
 
-  void reset();
-  void draw(vk::CommandBuffer cmd, vk::DescriptorSet drawDescriptors);
-  
+  // Move everything drawn since the last call into `frame`, reusing its
+  // storage for the next. Must be called on the main thread
+  void takeFrame(Frame& frame);
+  // Upload and record a frame's geometry. Must be called on the render thread
+  void draw(vk::CommandBuffer cmd, vk::DescriptorSet drawDescriptors,
+            std::span<const vk::DescriptorSet> staticDescriptors,
+            const Frame& frame);
+
   void initPipelines();
 
-  // Draw a line, must be called every frame
+  // Draw a line, must be called every frame. Drawing functions must only be
+  // called on the main thread
   void drawLine(const DebugLine& line);
   void drawAxisLines(glm::vec3 position, float length = 1.0f);
   void drawBox(glm::vec3 origin, glm::vec3 halfExtent, glm::vec4 color);
   void drawSphere(glm::vec3 origin, float radius, glm::vec4 color,
                   int resolution = 16);
   void drawMesh(const glm::mat4& transform, const Mesh& mesh) {
-    mDebugMeshes.emplace_back(transform, mesh);
+    mPending.mMeshes.emplace_back(transform, mesh);
   }
 
 private:
   Pipeline mPipeline;
   Pipeline mSolidPipeline;
-  std::vector<DebugMesh> mDebugMeshes;
+  // Drawn by the main thread since the last takeFrame
+  Frame mPending;
 
   // TODO: Does this need to be frame-level data?
+  // Only written by the render thread
   BufferMap::Handle mBuffer;
   std::unique_ptr<core::BumpAllocator> mAllocator;
-  size_t mLineCount = 0;
 };
 } // namespace selwonk::vulkan
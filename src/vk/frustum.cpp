@@ -22,9 +22,15 @@ bool Plane::sphereInPlane(const glm::vec3& position, float radius) const {
 
 bool Frustum::inFrustum(const glm::mat4& transform,
                         const Mesh::Bounds& node) const {
+  return inFrustum(Mesh::Bounds{
+      .origin = glm::vec3(transform * glm::vec4(node.origin, 1.0f)),
+      .radius = node.radius,
+  });
+}
+
+bool Frustum::inFrustum(const Mesh::Bounds& worldBounds) const {
   for (int p = 0; p < 6; p++) {
-    if (!planes[p].sphereInPlane(transform * glm::vec4(node.origin, 1.0f),
-                                 node.radius)) {
+    if (!planes[p].sphereInPlane(worldBounds.origin, worldBounds.radius)) {
       return false;
     }
   }
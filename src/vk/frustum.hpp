@@ -34,6 +34,8 @@ public:
   // Fill the frustum with planes extracted from the view-projection matrix
   void fillFromMatrix(const glm::mat4& viewProj);
   bool inFrustum(const glm::mat4& transform, const Mesh::Bounds& n) const;
+  // Check bounds that are already in world space
+  bool inFrustum(const Mesh::Bounds& worldBounds) const;
 
 protected:
   std::array<Plane, 6> planes;
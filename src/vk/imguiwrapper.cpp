@@ -45,6 +45,8 @@ void ImguiWrapper::init(VulkanHandle& handle, SDL_Window* window) {
       .Queue = handle.mGraphicsQueue,
       .DescriptorPool = mDescriptorPool,
       .MinImageCount = 3,
+      // Buffers are recycled after this many frames, which must cover every
+      // frame in flight plus the one being recorded on the render thread
       .ImageCount = 3,
       .MSAASamples = VK_SAMPLE_COUNT_1_BIT,
       .UseDynamicRendering = true,
@@ -59,14 +61,29 @@ void ImguiWrapper::init(VulkanHandle& handle, SDL_Window* window) {
   ImGui_ImplVulkan_CreateFontsTexture();
 }
 
+void ImguiWrapper::updateTextures(VulkanHandle& handle,
+                                  ImDrawData* drawData) {
+#if IMGUI_VERSION_NUM >= 19200
+  if (drawData == nullptr || drawData->Textures == nullptr)
+    return;
+  // The backend submits uploads itself, while the render thread may be
+  // presenting
+  auto lock = handle.lockQueue();
+  for (auto* texture : *drawData->Textures) {
+    if (texture->Status != ImTextureStatus_OK)
+      ImGui_ImplVulkan_UpdateTexture(texture);
+  }
+#endif
+}
+
 void ImguiWrapper::draw(VulkanHandle& handle, vk::CommandBuffer cmd,
-                        vk::ImageView target) {
+                        vk::ImageView target, ImDrawData* drawData) {
   auto colorAttach = VulkanInit::renderAttachInfo(target, /*clear=*/nullptr);
   auto renderInfo =
       VulkanInit::renderInfo(handle.swapchainExtent2d(), &colorAttach, nullptr);
 
   cmd.beginRendering(&renderInfo);
-  ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
+  ImGui_ImplVulkan_RenderDrawData(drawData, cmd);
   cmd.endRendering();
 }
 
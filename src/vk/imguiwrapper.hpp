@@ -2,13 +2,23 @@
 
 #include "vulkan/vulkan.hpp"
 #include "vulkanhandle.hpp"
+
+struct ImDrawData;
+
 namespace selwonk::vulkan {
 class ImguiWrapper {
 public:
   void init(VulkanHandle& handle, SDL_Window* window);
   void destroy(VulkanHandle& handle);
 
-  void draw(VulkanHandle& handle, vk::CommandBuffer cmd, vk::ImageView target);
+  // Upload or destroy textures that changed while building the frame. Must be
+  // called on the main thread after ImGui::Render, and before the draw data
+  // is captured, as the render thread never touches textures
+  void updateTextures(VulkanHandle& handle, ImDrawData* drawData);
+
+  // Draw ImGui's output, which may be a snapshot of an earlier frame
+  void draw(VulkanHandle& handle, vk::CommandBuffer cmd, vk::ImageView target,
+            ImDrawData* drawData);
 
 private:
   vk::Fence mFence;
@@ -10,9 +10,16 @@
 
 namespace selwonk::vulkan {
 
+namespace {
+// Vertices per job when converting attributes. Each vertex is cheap to
+// convert, so keep chunks large enough to amortise scheduling
+const static constexpr size_t VertexGrainSize = 4096;
+} // namespace
+
 std::unique_ptr<Mesh>
 Mesh::load(const fastgltf::Asset& asset, const fastgltf::Mesh& mesh,
            const std::vector<std::shared_ptr<Material>>& materials) {
+  auto& pool = VulkanEngine::get().getThreadPool();
   Data data;
   for (auto& primitive : mesh.primitives) {
     auto& indices = asset.accessors[primitive.indicesAccessor.value()];
@@ -27,17 +34,26 @@ Mesh::load(const fastgltf::Asset& asset, const fastgltf::Mesh& mesh,
       surface.mMaterial = VulkanEngine::get().mDefaultMaterial;
     data.surfaces.push_back(surface);
 
+    // Accessors support random access, so size everything up front and let
+    // each job write its own slice
     auto& positions =
         asset.accessors[primitive.findAttribute(AttrPosition)->accessorIndex];
-    fastgltf::iterateAccessor<glm::vec3>(asset, positions, [&](auto&& pos) {
-      data.vertices.push_back({.position = pos});
+    data.vertices.resize(startVertex + positions.count);
+    pool.parallelFor({0, positions.count}, VertexGrainSize, [&](size_t i) {
+      data.vertices[startVertex + i] = {
+          .position =
+              fastgltf::getAccessorElement<glm::vec3>(asset, positions, i)};
     });
 
-    fastgltf::iterateAccessor<uint32_t>(asset, indices, [&](uint32_t idx) {
-      data.indices.push_back(idx + startVertex);
-      assert(data.indices.back() < data.vertices.size() &&
+    data.indices.resize(surface.mIndexOffset + indices.count);
+    pool.parallelFor({0, indices.count}, VertexGrainSize, [&](size_t i) {
+      uint32_t idx =
+          fastgltf::getAccessorElement<uint32_t>(asset, indices, i) +
+          startVertex;
+      assert(idx < data.vertices.size() &&
              "Index out of bounds, undefined behaviour or read from different "
              "submesh");
+      data.indices[surface.mIndexOffset + i] = idx;
     });
 
 #define UPSERT_ATTR(name, field, type)                                         \
@@ -45,20 +61,21 @@ Mesh::load(const fastgltf::Asset& asset, const fastgltf::Mesh& mesh,
     auto attr = primitive.findAttribute(name);                                 \
     if (attr != primitive.attributes.end()) {                                  \
       auto& access = asset.accessors[attr->accessorIndex];                     \
-      fastgltf::iterateAccessorWithIndex<type>(                                \
-          asset, access, [&](auto&& value, size_t index) {                     \
-            data.vertices[startVertex + index].field = value;                  \
-          });                                                                  \
+      pool.parallelFor({0, access.count}, VertexGrainSize, [&](size_t index) { \
+        data.vertices[startVertex + index].field =                             \
+            fastgltf::getAccessorElement<type>(asset, access, index);          \
+      });                                                                      \
     }                                                                          \
   }
     auto uvs = primitive.findAttribute(AttrUv);
     if (uvs != primitive.attributes.end()) {
       auto& access = asset.accessors[uvs->accessorIndex];
-      fastgltf::iterateAccessorWithIndex<glm::vec2>(
-          asset, access, [&](auto&& value, size_t index) {
-            data.vertices[startVertex + index].uvX = value.x;
-            data.vertices[startVertex + index].uvY = value.y;
-          });
+      pool.parallelFor({0, access.count}, VertexGrainSize, [&](size_t index) {
+        auto value =
+            fastgltf::getAccessorElement<glm::vec2>(asset, access, index);
+        data.vertices[startVertex + index].uvX = value.x;
+        data.vertices[startVertex + index].uvY = value.y;
+      });
     }
 
     UPSERT_ATTR(AttrNormal, normal, glm::vec3)
@@ -70,22 +87,44 @@ Mesh::load(const fastgltf::Asset& asset, const fastgltf::Mesh& mesh,
       }
     }
   }
-  glm::vec3 min = data.vertices[0].position;
-  glm::vec3 max = data.vertices[0].position;
-  for (auto& vtx : data.vertices) {
-    min = glm::min(min, vtx.position);
-    max = glm::max(max, vtx.position);
-  }
+
+  struct Extents {
+    glm::vec3 min;
+    glm::vec3 max;
+  };
+  glm::vec3 first = data.vertices[0].position;
+  auto extents = pool.parallelReduce(
+      ThreadPool::Range{0, data.vertices.size()}, VertexGrainSize,
+      Extents{first, first},
+      [&](Extents acc, size_t i) {
+        acc.min = glm::min(acc.min, data.vertices[i].position);
+        acc.max = glm::max(acc.max, data.vertices[i].position);
+        return acc;
+      },
+      [](Extents a, Extents b) {
+        return Extents{glm::min(a.min, b.min), glm::max(a.max, b.max)};
+      });
   Bounds bounds;
-  bounds.origin = (min + max) / 2.0f;
-  bounds.radius = glm::length(min - max) / 2.0f;
+  bounds.origin = (extents.min + extents.max) / 2.0f;
+  bounds.radius = glm::length(extents.min - extents.max) / 2.0f;
 
   return std::make_unique<Mesh>(mesh.name, std::move(data), bounds);
 }
 
+Mesh::AssetId Mesh::assetId(std::string_view name) {
+  // 64-bit FNV-1a, which is stable across platforms and standard libraries
+  // unlike std::hash
+  AssetId hash = 0xcbf29ce484222325;
+  for (char c : name) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
 Mesh::Mesh(std::string_view name, Data data, Bounds bounds)
     : mSurfaces(std::move(data.surfaces)), mBounds(bounds), name(name),
-      mIndexCount(data.indices.size()) {
+      mAssetId(assetId(name)), mIndexCount(data.indices.size()) {
   mIndexBufferIndex = VulkanEngine::get().getIndexBuffers().insert(
       std::span(data.indices), Buffer::Usage::BindlessIndex);
   mVertexIndex = VulkanEngine::get().getVertexBuffers().insert(
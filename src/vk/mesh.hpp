@@ -11,6 +11,9 @@
 namespace selwonk::vulkan {
 class Mesh {
 public:
+  // Identifies a mesh across runs, such as in an ECS snapshot
+  using AssetId = uint64_t;
+
   struct Bounds {
     glm::vec3 origin;
     float radius;
@@ -33,6 +36,10 @@ public:
   load(const fastgltf::Asset& asset, const fastgltf::Mesh& mesh,
        const std::vector<std::shared_ptr<Material>>& materials);
 
+  // Stable ID for a mesh with the given name. Meshes are assumed to have
+  // unique names
+  static AssetId assetId(std::string_view name);
+
   Mesh(std::string_view name, Data data, Bounds bounds);
   ~Mesh();
 
@@ -45,6 +52,7 @@ public:
   std::vector<Surface> mSurfaces;
   Bounds mBounds;
   std::string name;
+  AssetId mAssetId;
   size_t mIndexCount;
 
   BufferMap::Handle mIndexBufferIndex;
@@ -52,12 +52,13 @@ glm::vec4 GltfMesh::convertVector(const fastgltf::math::nvec4& vec) {
   return glm::vec4(vec[0], vec[1], vec[2], vec[3]);
 }
 
-fastgltf::Asset MeshLoader::loadAsset(Vfs::SubdirPath path) {
+Task<fastgltf::Asset>
+MeshLoader::loadAssetAsync(std::filesystem::path path) {
   auto& vfs = VulkanEngine::get().getVfs();
   fmt::println("Loading gltf {}", path.string());
 
   std::vector<std::byte> buffer;
-  vfs.readfull(Vfs::Meshes / path, buffer);
+  co_await vfs.readAsync(Vfs::Meshes / path, buffer);
 
   auto data = fastgltf::GltfDataBuffer::FromBytes(buffer.data(), buffer.size());
   if (data.error() != fastgltf::Error::None) {
@@ -72,7 +73,7 @@ fastgltf::Asset MeshLoader::loadAsset(Vfs::SubdirPath path) {
     throw LoadException(load.error());
   }
 
-  return std::move(load.get());
+  co_return std::move(load.get());
 }
 
 GltfMesh::~GltfMesh() { mMaterialData.free(VulkanHandle::get().mAllocator); }
@@ -199,42 +200,57 @@ GltfMesh::GltfMesh(const fastgltf::Asset& asset) {
       mRootNodes[node.name.c_str()] = sceneNode;
     }
   }
-}
 
-void GltfMesh::Node::instantiate(ecs::Registry& ecs,
-                                 const ecs::Transform& transform) {
-  auto entity = ecs.createEntity();
-  auto localModelMat = transform.apply(mLocalTransform);
+  mPrefab = compilePrefab();
+}
 
-  ecs.addComponent<ecs::Transform>(entity, {localModelMat});
-  if (mMesh != nullptr) {
-    ecs.addComponent<ecs::Renderable>(entity, {
-                                                  .mMesh = mMesh,
-                                              });
-  }
-  // TODO: Remove debug hide
-  if (mName.starts_with("LightShaft")) {
-    ecs.setEnabled(entity, false);
+std::shared_ptr<const ecs::Prefab> GltfMesh::compilePrefab() const {
+  auto prefab = std::make_shared<ecs::Prefab>();
+  // Breadth-first, so that parents are always added before their children
+  std::vector<std::pair<const Node*, uint32_t>> queue;
+  for (auto& root : mRootNodes) {
+    queue.emplace_back(root.second.get(), ecs::Prefab::NoParent);
   }
-
-  if (!mName.empty()) {
-    ecs.addComponent<ecs::Named>(entity, {mName});
+  for (size_t i = 0; i < queue.size(); i++) {
+    auto [node, parent] = queue[i];
+    ecs::Prefab::Node prefabNode = {
+        .mParent = parent,
+        .mLocal = node->mLocalTransform,
+        // TODO: Remove debug hide
+        .mEnabled = !node->mName.starts_with("LightShaft"),
+    };
+    if (node->mMesh != nullptr)
+      prefabNode.mRenderable = ecs::Renderable{.mMesh = node->mMesh};
+    if (!node->mName.empty())
+      prefabNode.mNamed = ecs::Named{node->mName};
+
+    auto index = prefab->addNode(prefabNode);
+    for (auto& child : node->mChildren) {
+      queue.emplace_back(child.get(), index);
+    }
   }
+  return prefab;
+}
 
-  for (auto& child : mChildren) {
-    child->instantiate(ecs, {localModelMat});
+void GltfMesh::addAssets(ecs::Snapshot::Assets& assets) const {
+  for (auto& [name, mesh] : mMeshes) {
+    assets.addMesh(mesh);
   }
 }
 
 void GltfMesh::instantiate(ecs::Registry& ecs,
                            const ecs::Transform& transform) {
-  for (auto& root : mRootNodes) {
-    root.second->instantiate(ecs, transform);
-  }
+  instantiate(ecs, std::span(&transform, 1));
+}
+
+void GltfMesh::instantiate(ecs::Registry& ecs,
+                           std::span<const ecs::Transform> transforms) {
+  mPrefab->instantiate(ecs, transforms);
 }
 
 std::unique_ptr<GltfMesh> MeshLoader::loadGltf(Vfs::SubdirPath path) {
-  auto asset = loadAsset(path);
+  auto& pool = VulkanEngine::get().getThreadPool();
+  auto asset = syncWait(pool, loadAssetAsync(path));
 
   return std::make_unique<GltfMesh>(asset);
 }
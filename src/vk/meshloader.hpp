@@ -5,6 +5,8 @@
 #include <unordered_map>
 
 #include "../ecs/registry.hpp"
+#include "../ecs/snapshot.hpp"
+#include "../task.hpp"
 
 #include "buffer.hpp"
 #include "fastgltf/types.hpp"
@@ -19,6 +21,15 @@ public:
   template <typename T>
   using StringMap = std::unordered_map<std::string, std::shared_ptr<T>>;
   void instantiate(ecs::Registry& ecs, const ecs::Transform& transform);
+  // Create a copy of the mesh at each transform. Every node is created for all
+  // copies at once, which is much faster than instantiating them one by one
+  void instantiate(ecs::Registry& ecs,
+                   std::span<const ecs::Transform> transforms);
+  // The scene as a prefab, which can be instantiated from any system with
+  // ecs::Prefab::Instantiate
+  std::shared_ptr<const ecs::Prefab> prefab() const { return mPrefab; }
+  // Make the meshes available to snapshots being loaded
+  void addAssets(ecs::Snapshot::Assets& assets) const;
 
   struct Node {
     Node* mParent;
@@ -26,8 +37,6 @@ public:
     std::shared_ptr<Mesh> mMesh;
     ecs::Transform mLocalTransform;
     std::string mName;
-
-    void instantiate(ecs::Registry& ecs, const ecs::Transform& transform);
   };
   StringMap<Node> mRootNodes;
 
@@ -36,6 +45,11 @@ public:
   Buffer mMaterialData;
 
 private:
+  // Flatten the node tree, done once on load
+  std::shared_ptr<const ecs::Prefab> compilePrefab() const;
+
+  std::shared_ptr<const ecs::Prefab> mPrefab;
+
   static fastgltf::Asset loadAsset(Vfs::SubdirPath path);
 
   static vk::Filter convertFilter(fastgltf::Optional<fastgltf::Filter> filter);
@@ -59,7 +73,10 @@ public:
 
   static std::unique_ptr<GltfMesh> loadGltf(Vfs::SubdirPath path);
 
-private:
-  static fastgltf::Asset loadAsset(Vfs::SubdirPath path);
+  // Read and parse a glTF asset. The read suspends rather than blocks, so many
+  // assets can be loaded at once with whenAll. Turning the result into a
+  // GltfMesh uploads to the GPU, which must be done from the main thread
+  // Takes the path by value, as the task may outlive the caller's copy
+  static Task<fastgltf::Asset> loadAssetAsync(std::filesystem::path path);
 };
 } // namespace selwonk::vulkan
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <imgui.h>
+
+#include "../../assets/shaders/gradient.h"
+#include "../ecs/camera.hpp"
+#include "debug.hpp"
+#include "image.hpp"
+#include "mesh.hpp"
+
+namespace selwonk::vulkan {
+// Copy of ImGui's draw data, as ImGui reuses its own once the next frame
+// begins. Owns everything the backend reads while drawing: the vertices,
+// indices and commands of each list, the display size, and texture IDs, so
+// nothing is shared with the ImGui context the next frame is built in
+// Textures must be updated before capture, see ImguiWrapper::updateTextures
+class ImguiSnapshot {
+public:
+  ImguiSnapshot() = default;
+  ~ImguiSnapshot() { clear(); }
+
+  // No copy, the draw lists are owned
+  ImguiSnapshot(const ImguiSnapshot&) = delete;
+  ImguiSnapshot& operator=(const ImguiSnapshot&) = delete;
+
+  // Replace the snapshot with a copy of data, such as ImGui::GetDrawData()
+  void capture(const ImDrawData& data) {
+    clear();
+    mData = data;
+    mData.OwnerViewport = nullptr;
+    for (auto& list : mData.CmdLists) {
+      list = list->CloneOutput();
+    }
+#if IMGUI_VERSION_NUM >= 19200
+    // Texture references point into the context, resolve them to plain IDs.
+    // The backend only processes texture updates when given the list
+    mData.Textures = nullptr;
+    for (auto* list : mData.CmdLists) {
+      for (auto& cmd : list->CmdBuffer) {
+        cmd.TexRef = ImTextureRef(cmd.GetTexID());
+      }
+    }
+#endif
+  }
+
+  // Get the captured data, or nullptr if there is none
+  ImDrawData* get() { return mData.Valid ? &mData : nullptr; }
+
+private:
+  void clear() {
+    for (auto* list : mData.CmdLists) {
+      IM_DELETE(list);
+    }
+    mData.Clear();
+  }
+
+  ImDrawData mData;
+};
+
+// Everything needed to record a frame, extracted from the registry by
+// RenderSystem. The render thread only reads this, never components, so the
+// next frame can be simulated while this one is recorded
+struct RenderList {
+  // A camera to draw the scene from
+  struct View {
+    glm::mat4 mView;
+    ecs::Camera mCamera;
+  };
+  struct Item {
+    glm::mat4 mModel;
+    Mesh::Bounds mWorldBounds;
+    // Not owned. Meshes must already outlive the frames in flight, as the GPU
+    // reads their buffers
+    const Mesh* mMesh;
+  };
+
+  std::vector<View> mViews;
+  std::vector<Item> mItems;
+  // Copied to the swapchain once every view is drawn
+  std::shared_ptr<Image> mPresentTarget;
+  interop::GradientPushConstants mBackground;
+  ImguiSnapshot mImgui;
+  Debug::Frame mDebug;
+
+  // Written by the render thread, read once the list is handed back
+  int mDrawn = 0;
+
+  // Empty the list for reuse, keeping its storage
+  void clear() {
+    mViews.clear();
+    mItems.clear();
+    mPresentTarget.reset();
+    mDrawn = 0;
+  }
+};
+} // namespace selwonk::vulkan
@@ -6,20 +6,84 @@
 #include "imagehelpers.hpp"
 #include "vulkan/vulkan.hpp"
 #include "vulkanengine.hpp"
+#include <imgui.h>
 #include <vulkan/vk_enum_string_helper.h>
 
 namespace selwonk::vulkan {
-RenderSystem::RenderSystem(VulkanEngine& engine) : mEngine(engine) {}
+RenderSystem::RenderSystem(VulkanEngine& engine)
+    : mEngine(engine), mThread([this](RenderList& list) { record(list); }) {}
 
 void RenderSystem::update(ecs::Registry& registry, Duration dt) {
-  mEngine.prepareRendering();
+  auto& list = mThread.back();
+  // The list was last drawn two frames ago, so these are a frame behind
+  auto& metrics = core::Profiler::get().getExtraMetrics();
+  metrics.drawnRenderable = list.mDrawn;
+  metrics.totalRenderable = static_cast<int>(list.mItems.size());
+
+  list.clear();
+  extract(registry, list);
+  if (auto* drawData = ImGui::GetDrawData())
+    list.mImgui.capture(*drawData);
+  mThread.submit();
+}
+
+void RenderSystem::extract(ecs::Registry& registry, RenderList& list) {
+  updateWorldBounds(registry);
 
   registry.forEach<ecs::Transform, ecs::Camera>(
       [&](ecs::EntityRef entity, const ecs::Transform& transform,
-          const ecs::Camera& camera) { draw(transform, camera); });
+          const ecs::Camera& camera) {
+        list.mViews.push_back({
+            .mView = glm::inverse(transform.modelMatrix()),
+            .mCamera = camera,
+        });
+      });
+  registry.forEach<ecs::WorldTransform, ecs::Renderable>(
+      [&](ecs::EntityRef entity, const ecs::WorldTransform& world,
+          const ecs::Renderable& renderable) {
+        list.mItems.push_back({
+            .mModel = world.mMatrix,
+            .mWorldBounds = mWorldBounds[entity.id()],
+            .mMesh = renderable.mMesh.get(),
+        });
+      });
+
+  list.mPresentTarget =
+      registry.getComponent<ecs::Camera>(mEngine.mCamera->getCamera())
+          .mDrawTarget;
+  list.mBackground = mEngine.mPushConstants;
+  Debug::get().takeFrame(list.mDebug);
 }
 
-void RenderSystem::drawBackground(vk::CommandBuffer cmd) {
+void RenderSystem::record(RenderList& list) {
+  mEngine.prepareRendering();
+  for (auto& view : list.mViews) {
+    draw(list, view);
+  }
+  mEngine.present(list);
+}
+
+void RenderSystem::updateWorldBounds(ecs::Registry& registry) {
+  // Most of the scene is static, so only a handful of entities change each
+  // frame
+  registry.forEachChanged<ecs::WorldTransform, ecs::Renderable>(
+      mWorldBoundsVersion,
+      [&](ecs::EntityRef entity, const ecs::WorldTransform& world,
+          const ecs::Renderable& renderable) {
+        if (mWorldBounds.size() <= entity.id())
+          mWorldBounds.resize(entity.id() + 1);
+        auto& bounds = renderable.mMesh->mBounds;
+        mWorldBounds[entity.id()] = {
+            .origin = glm::vec3(world.mMatrix * glm::vec4(bounds.origin, 1.0f)),
+            .radius = bounds.radius,
+        };
+      });
+  mWorldBoundsVersion = registry.changeVersion();
+}
+
+void RenderSystem::drawBackground(vk::CommandBuffer cmd,
+                                  const RenderList& list,
+                                  const ecs::Camera& camera) {
   cmd.bindPipeline(vk::PipelineBindPoint::eCompute,
                    mEngine.mGradientShader.mPipeline);
   cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
@@ -31,15 +95,17 @@ void RenderSystem::drawBackground(vk::CommandBuffer cmd) {
 
   cmd.pushConstants(
       mEngine.mGradientShader.mLayout, vk::ShaderStageFlags::BitsType::eCompute,
-      0, sizeof(interop::GradientPushConstants), &mEngine.mPushConstants);
+      0, sizeof(interop::GradientPushConstants), &list.mBackground);
 
+  // The window may have been resized since, so use the target's own size
+  auto extent = camera.mDrawTarget->getExtent();
   const int workgroupSize = 16;
-  vkCmdDispatch(cmd, std::ceil(mEngine.mWindow.getSize().x / workgroupSize) + 1,
-                std::ceil(mEngine.mWindow.getSize().y / workgroupSize) + 1, 1);
+  vkCmdDispatch(cmd, std::ceil(extent.width / workgroupSize) + 1,
+                std::ceil(extent.height / workgroupSize) + 1, 1);
 }
 
-void RenderSystem::drawScene(const ecs::Transform& cameraTransform,
-                             const ecs::Camera& camera) {
+void RenderSystem::drawScene(RenderList& list, const RenderList::View& view) {
+  auto& camera = view.mCamera;
   auto& frameData = mEngine.getCurrentFrame();
   auto cmd = frameData.mCommandBuffer;
   vk::Extent2D extent = {
@@ -68,9 +134,8 @@ void RenderSystem::drawScene(const ecs::Transform& cameraTransform,
       staticDescriptors.data(),
       /*dynamicOffsetCount=*/0, /*pDynamicOffsets=*/nullptr);
 
-  auto view = glm::inverse(cameraTransform.modelMatrix());
   auto projection = camera.getMatrix();
-  auto viewProj = projection * view;
+  auto viewProj = projection * view.mView;
   frameData.mSceneUniforms.data()->viewProjection = viewProj;
 
   vk::Viewport viewport = {
@@ -93,52 +158,44 @@ void RenderSystem::drawScene(const ecs::Transform& cameraTransform,
   clip.fillFromMatrix(viewProj);
 
   int drawn = 0;
-  int total = 0;
 
   // TODO: Make this as bindless as possible
-  mEngine.mEcs.forEach<ecs::Transform, ecs::Renderable>(
-      [&](ecs::EntityRef entity, ecs::Transform& transform,
-          ecs::Renderable& renderable) {
-        auto modelMatrix = transform.modelMatrix();
-
-        total++;
-        if (!clip.inFrustum(modelMatrix, renderable.mMesh->mBounds)) {
-          return;
-        }
-        drawn++;
-
-        for (auto& surface : renderable.mMesh->mSurfaces) {
-          interop::VertexPushConstants pushConstants = {
-              .modelMatrix = modelMatrix,
-              .materialData = surface.mMaterial->mData,
-              .indexBufferIndex = renderable.mMesh->mIndexBufferIndex.value(),
-              .textureIndex = surface.mMaterial->mTexture.value(),
-              .samplerIndex = surface.mMaterial->mSampler.value(),
-              .vertexIndex = renderable.mMesh->mVertexIndex.value(),
-          };
-          cmd.pushConstants(mEngine.mOpaquePipeline.getLayout(),
-                            vk::ShaderStageFlagBits::eVertex |
-                                vk::ShaderStageFlagBits::eFragment,
-                            0, sizeof(interop::VertexPushConstants),
-                            &pushConstants);
-
-          cmd.draw(surface.mIndexCount, /*instanceCount=*/1,
-                   /*firstVertex=*/surface.mIndexOffset,
-                   /*firstInstance=*/0);
-        }
-      });
-
-  core::Profiler::get().getExtraMetrics().drawnRenderable = drawn;
-  core::Profiler::get().getExtraMetrics().totalRenderable = total;
-
-  Debug::get().draw(cmd, frameData.mSceneUniformDescriptor.getSet());
-  Debug::get().reset();
+  for (auto& item : list.mItems) {
+    if (!clip.inFrustum(item.mWorldBounds)) {
+      continue;
+    }
+    drawn++;
+
+    for (auto& surface : item.mMesh->mSurfaces) {
+      interop::VertexPushConstants pushConstants = {
+          .modelMatrix = item.mModel,
+          .materialData = surface.mMaterial->mData,
+          .indexBufferIndex = item.mMesh->mIndexBufferIndex.value(),
+          .textureIndex = surface.mMaterial->mTexture.value(),
+          .samplerIndex = surface.mMaterial->mSampler.value(),
+          .vertexIndex = item.mMesh->mVertexIndex.value(),
+      };
+      cmd.pushConstants(mEngine.mOpaquePipeline.getLayout(),
+                        vk::ShaderStageFlagBits::eVertex |
+                            vk::ShaderStageFlagBits::eFragment,
+                        0, sizeof(interop::VertexPushConstants),
+                        &pushConstants);
+
+      cmd.draw(surface.mIndexCount, /*instanceCount=*/1,
+               /*firstVertex=*/surface.mIndexOffset,
+               /*firstInstance=*/0);
+    }
+  }
+  list.mDrawn = drawn;
+
+  Debug::get().draw(cmd, frameData.mSceneUniformDescriptor.getSet(),
+                    staticDescriptors, list.mDebug);
 
   cmd.endRendering();
 }
 
-void RenderSystem::draw(const ecs::Transform& cameraTransform,
-                        const ecs::Camera& camera) {
+void RenderSystem::draw(RenderList& list, const RenderList::View& view) {
+  auto& camera = view.mCamera;
   auto& frame = mEngine.getCurrentFrame();
   auto cmd = frame.mCommandBuffer;
 
@@ -151,13 +208,13 @@ void RenderSystem::draw(const ecs::Transform& cameraTransform,
                                 vk::ImageLayout::eUndefined,
                                 vk::ImageLayout::eDepthAttachmentOptimal);
 
-  drawBackground(cmd);
+  drawBackground(cmd, list, camera);
 
   ImageHelpers::transitionImage(cmd, camera.mDrawTarget->getImage(),
                                 vk::ImageLayout::eGeneral,
                                 vk::ImageLayout::eColorAttachmentOptimal);
 
-  drawScene(cameraTransform, camera);
+  drawScene(list, view);
 
   // Make the draw image readable again
   ImageHelpers::transitionImage(cmd, camera.mDrawTarget->getImage(),
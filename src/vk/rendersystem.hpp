@@ -1,14 +1,27 @@
 #pragma once
 
 #include "../ecs/camera.hpp"
+#include "../ecs/registry.hpp"
+#include "../ecs/renderable.hpp"
 #include "../ecs/system.hpp"
 #include "../ecs/transform.hpp"
+#include "mesh.hpp"
+#include "renderlist.hpp"
+#include "renderthread.hpp"
+#include <vector>
 #include <vulkan/vulkan.hpp>
 
 namespace selwonk::vulkan {
 class VulkanEngine;
 
-class RenderSystem : public ecs::System {
+// Extracts what is visible into a RenderList, then hands it to a render thread
+// to record and present while the next frame is simulated. Uses ImGui's draw
+// data, so must run on the main thread
+class RenderSystem
+    : public ecs::TypedSystem<
+          ecs::Reads<ecs::Transform, ecs::WorldTransform, ecs::Renderable,
+                     ecs::Camera>,
+          ecs::Writes<>, /*MainThread=*/true> {
 public:
   RenderSystem(VulkanEngine& engine);
 
@@ -19,12 +32,30 @@ public:
   }
   std::string_view name() const noexcept override { return "Render"; }
 
+  // Wait for the frame being recorded to finish, such as before recreating
+  // resources it uses
+  void wait() { mThread.wait(); }
+  std::exception_ptr waitNoThrow() noexcept { return mThread.waitNoThrow(); }
+
 private:
-  void drawScene(const ecs::Transform& cameraTransform,
-                 const ecs::Camera& camera);
-  void drawBackground(vk::CommandBuffer cmd);
-  void draw(const ecs::Transform& cameraTransform, const ecs::Camera& camera);
+  // Recalculate world space bounds of renderables whose world transform or
+  // mesh changed since last time
+  void updateWorldBounds(ecs::Registry& registry);
+  void extract(ecs::Registry& registry, RenderList& list);
+
+  // Called on the render thread
+  void record(RenderList& list);
+  void drawScene(RenderList& list, const RenderList::View& view);
+  void drawBackground(vk::CommandBuffer cmd, const RenderList& list,
+                      const ecs::Camera& camera);
+  void draw(RenderList& list, const RenderList::View& view);
 
   VulkanEngine& mEngine;
+  // Indexed by entity ID
+  std::vector<Mesh::Bounds> mWorldBounds;
+  ecs::Registry::ChangeVersion mWorldBoundsVersion = 0;
+
+  // Last, so that it is joined before anything it uses is destroyed
+  RenderThread mThread;
 };
 } // namespace selwonk::vulkan
@@ -0,0 +1,68 @@
+#include "renderthread.hpp"
+
+#include <utility>
+
+#include <tracy/Tracy.hpp>
+
+namespace selwonk::vulkan {
+RenderThread::RenderThread(Draw draw)
+    : mDraw(std::move(draw)), mThread([this] { run(); }) {}
+
+RenderThread::~RenderThread() {
+  {
+    std::lock_guard lock(mMtx);
+    mQuit = true;
+  }
+  mCv.notify_all();
+  mThread.join();
+}
+
+void RenderThread::submit() {
+  wait();
+  {
+    std::lock_guard lock(mMtx);
+    mFront = &mLists[mBack];
+  }
+  mCv.notify_all();
+  mBack = (mBack + 1) % mLists.size();
+}
+
+void RenderThread::wait() {
+  if (auto error = waitNoThrow())
+    std::rethrow_exception(error);
+}
+
+std::exception_ptr RenderThread::waitNoThrow() noexcept {
+  std::unique_lock lock(mMtx);
+  mCv.wait(lock, [this] { return mFront == nullptr; });
+  return std::exchange(mError, nullptr);
+}
+
+void RenderThread::run() {
+  // Also names the thread for the OS, and therefore debuggers
+  tracy::SetThreadName("Render");
+
+  std::unique_lock lock(mMtx);
+  while (true) {
+    mCv.wait(lock, [this] { return mFront != nullptr || mQuit; });
+    // A submitted frame is always finished before quitting
+    if (mFront == nullptr)
+      return;
+
+    auto* list = mFront;
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      mDraw(*list);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    lock.lock();
+
+    if (error)
+      mError = error;
+    mFront = nullptr;
+    mCv.notify_all();
+  }
+}
+} // namespace selwonk::vulkan
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "renderlist.hpp"
+
+namespace selwonk::vulkan {
+// Records and submits frames on a dedicated thread, so that the main thread can
+// simulate the next frame in the meantime. Render lists are double buffered:
+// the main thread fills one while the render thread draws the other
+class RenderThread {
+public:
+  using Draw = std::function<void(RenderList&)>;
+
+  explicit RenderThread(Draw draw);
+  // Finishes the frame in progress, if any
+  ~RenderThread();
+
+  // No copy
+  RenderThread(const RenderThread&) = delete;
+  RenderThread& operator=(const RenderThread&) = delete;
+
+  // List to fill for the next frame. Not touched by the render thread until
+  // it is submitted
+  RenderList& back() { return mLists[mBack]; }
+  // Hand the back list over to be drawn, once the previous frame is done. The
+  // previous frame's list becomes the new back list
+  void submit();
+  // Wait for the frame in progress to finish, such as before recreating
+  // resources it uses. Rethrows anything the frame threw
+  void wait();
+  // Like wait, but returns anything the frame threw rather than rethrowing it,
+  // for use where throwing is not allowed such as destructors
+  std::exception_ptr waitNoThrow() noexcept;
+
+private:
+  void run();
+
+  Draw mDraw;
+  std::array<RenderList, 2> mLists;
+  // Only used by the main thread
+  size_t mBack = 0;
+
+  std::mutex mMtx;
+  // Signalled when a list is submitted, finished, or the thread should quit
+  std::condition_variable mCv;
+  // List waiting to be or being drawn, if any
+  RenderList* mFront = nullptr;
+  std::exception_ptr mError;
+  bool mQuit = false;
+
+  // Last, so that it starts after everything it uses is initialised
+  std::thread mThread;
+};
+} // namespace selwonk::vulkan
@@ -1,6 +1,8 @@
 #include "vulkanengine.hpp"
 
 #include "../core/cvar.hpp"
+#include "../ecs/hierarchysystem.hpp"
+#include "../ecs/snapshot.hpp"
 #include "../platform.hpp"
 #include "../times.hpp"
 #include "imagehelpers.hpp"
@@ -14,10 +16,12 @@
 #include "vulkanhandle.hpp"
 #include "vulkaninit.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <filesystem>
 
 #include <VkBootstrap.h>
 #include <fmt/base.h>
@@ -42,10 +46,18 @@ core::Cvar::Int MaxSamplers("render.max_samplers", 32,
                             "Maximum number of samplers");
 core::Cvar::Int MaxTextures("render.max_textures", 8192,
                             "Maximum number of textures");
+core::Cvar::Int BackgroundJobBudget(
+    "jobs.background_budget_us", 2000,
+    "Thread time background jobs may use per frame, in microseconds");
 
 VulkanEngine::VulkanEngine(const core::Cli& cli, core::Settings& settings,
                            core::Window& window, VulkanHandle& handle)
     : mCli(cli), mSettings(settings), mWindow(window), mHandle(handle),
+      // The main thread also runs jobs while waiting on them
+      mThreadPool(std::max(1u, std::thread::hardware_concurrency()) - 1,
+                  cli.pinThreads),
+      mEcs(cli.archetypes ? ecs::StorageMode::Archetypes
+                          : ecs::StorageMode::Arrays),
       mSamplerCache(MaxSamplers), mTextureManager(MaxTextures) {
 
   fmt::println("Initializing Vulcanite Engine");
@@ -70,6 +82,25 @@ VulkanEngine::VulkanEngine(const core::Cli& cli, core::Settings& settings,
 }
 
 void VulkanEngine::initEcs() {
+  // The scene comes first, as snapshots can only be loaded into an empty
+  // registry. Meshes are always loaded from the glTF, a snapshot only replaces
+  // instantiating its nodes
+  mMesh = MeshLoader::loadGltf("third_party/structure.glb");
+  if (mCli.snapshot && std::filesystem::exists(*mCli.snapshot)) {
+    auto start = std::chrono::steady_clock::now();
+    ecs::Snapshot::Assets assets;
+    mMesh->addAssets(assets);
+    ecs::Snapshot::load(mEcs, *mCli.snapshot, assets);
+    fmt::println("Loaded snapshot {} in {:.2f}ms", *mCli.snapshot,
+                 std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start)
+                     .count());
+  } else {
+    mMesh->instantiate(mEcs, ecs::Transform{});
+    if (mCli.snapshot)
+      ecs::Snapshot::save(mEcs, *mCli.snapshot);
+  }
+
   // Allocate an image to fill the window
   auto draw = initDrawImage(mSettings.initialSize);
   auto cameraobj = mEcs.createEntity();
@@ -89,16 +120,25 @@ void VulkanEngine::initEcs() {
   mCamera = mEcs.addSystem(std::make_unique<CameraSystem>(
       cameraobj, mWindow.getKeyboard(), mWindow));
   mEcs.addCommandBarrier();
-  mEcs.addSystem(std::make_unique<RenderSystem>(*this));
-
-  mMesh = MeshLoader::loadGltf("third_party/structure.glb");
-  mMesh->instantiate(mEcs, ecs::Transform{});
+  mEcs.addSystem(std::make_unique<ecs::HierarchySystem>());
+  mRenderer = mEcs.addSystem(std::make_unique<RenderSystem>(*this));
 }
 
 VulkanEngine::~VulkanEngine() {
   fmt::println("Vulcanite shutting down. Goodbye!");
 
-  // Let the GPU finish its work
+  // Let the render thread, then the GPU, finish their work. Destructors must
+  // not throw, so only report what went wrong
+  if (auto error = mRenderer->waitNoThrow()) {
+    try {
+      std::rethrow_exception(error);
+    } catch (const std::exception& e) {
+      fmt::println(stderr, "Render thread failed during shutdown: {}",
+                   e.what());
+    } catch (...) {
+      fmt::println(stderr, "Render thread failed during shutdown");
+    }
+  }
   vkDeviceWaitIdle(mHandle.mDevice);
   for (auto& frameData : mFrameData) {
     frameData.destroy(mHandle, *this);
@@ -280,14 +320,19 @@ void VulkanEngine::initPipelines() {
 
 void VulkanEngine::run() {
   auto frameStart = std::chrono::steady_clock::now();
+  // Frames simulated. Rendering runs up to a frame behind, see RenderSystem
+  unsigned int frames = 0;
   while (!mWindow.quitRequested() && (!mCli.quitAfterFrames.has_value() ||
-                                      mFrameNumber < mCli.quitAfterFrames)) {
+                                      frames < mCli.quitAfterFrames)) {
     auto now = std::chrono::steady_clock::now();
     auto dt = now - frameStart;
     frameStart = now;
 
     ImGui::NewFrame();
     mProfiler.beginFrame();
+    mThreadPool.beginFrame(
+        std::chrono::microseconds(BackgroundJobBudget.value()));
+    mProfiler.recordWorkers(mThreadPool.workerStats());
     mProfiler.startSection("Input");
     mWindow.update();
 
@@ -304,20 +349,41 @@ void VulkanEngine::run() {
       ImGui::LabelText("Samplers", "%zu/%i", mSamplerCache.size(),
                        mSamplerCache.getCapacity());
 
-#ifdef VN_LOGCOMPONENTSTATS
+      // Time jobs spent queued last frame, and how much of that was while
+      // lower priority jobs were running
+      const static constexpr std::array<const char*, ThreadPool::PriorityCount>
+          LaneNames = {"Critical jobs", "Normal jobs", "Background jobs"};
+      for (size_t i = 0; i < ThreadPool::PriorityCount; i++) {
+        auto& stats =
+            mThreadPool.frameStats(static_cast<ThreadPool::Priority>(i));
+        auto ms = [](auto duration) {
+          return std::chrono::duration<float, std::milli>(duration).count();
+        };
+        ImGui::LabelText(LaneNames[i],
+                         "%zu, wait avg %.3fms max %.3fms behind lower %.3fms",
+                         stats.jobs, ms(stats.averageWait()),
+                         ms(stats.maxWait), ms(stats.waitBehindLower));
+      }
+
+      auto showStats = [](const char* name, const ecs::StoreStats& stats) {
+        ImGui::LabelText(name, "%zu/%zu (%.0f%%) %.1fKiB %s", stats.mCount,
+                         stats.mCapacity, stats.occupancy() * 100.0f,
+                         stats.mBytes / 1024.0f,
+                         stats.mSparse ? "sparse" : "dense");
+      };
       std::apply(
-          [](const auto&... componentArrays) {
-            ((ImGui::LabelText(
-                 componentArrays.getTypeName(), "Count: %zd, Capacity: %zd",
-                 componentArrays.size(), componentArrays.capacity())),
+          [&](const auto&... componentArrays) {
+            (showStats(componentArrays.getTypeName(), componentArrays.stats()),
              ...);
           },
           mEcs.getComponentArrays());
-#endif
+      ImGui::LabelText("Archetypes", "%zu",
+                       mEcs.getArchetypes().tableCount());
     }
     ImGui::End();
 
     ImGui::Render();
+    mImgui.updateTextures(mHandle, ImGui::GetDrawData());
 
     mProfiler.startSection("Load Shaders");
     // Changing a CVAR may invalidate pipelines, so we must check after GUI
@@ -325,11 +391,13 @@ void VulkanEngine::run() {
     if (mPipelinesDirty) {
       // Recreate pipelines on the first frame or when a descriptor's cvar
       // changes
+      mRenderer->wait();
       initPipelines();
       mDebug->initPipelines();
     }
 
     if (mWindow.resized()) {
+      mRenderer->wait();
       mHandle.resizeSwapchain(mWindow.getSize());
       auto draw = initDrawImage(mWindow.getSize());
       mEcs.queueCommand(ecs::Camera::SetTarget{
@@ -340,13 +408,14 @@ void VulkanEngine::run() {
       writeBackgroundDescriptors();
     }
 
+    // Hands the frame to the render thread, see RenderSystem
     mEcs.update(dt);
 
-    mProfiler.startSection("Present");
-    present();
-
     mProfiler.endFrame();
+    frames++;
   }
+  // Report any error from the last frame
+  mRenderer->wait();
 }
 
 VulkanEngine::FrameData& VulkanEngine::prepareRendering() {
@@ -368,10 +437,9 @@ VulkanEngine::FrameData& VulkanEngine::prepareRendering() {
   return frame;
 }
 
-void VulkanEngine::present() {
+void VulkanEngine::present(RenderList& list) {
   auto& frame = getCurrentFrame();
   auto cmd = frame.mCommandBuffer;
-  auto& camera = mEcs.getComponent<ecs::Camera>(mCamera->getCamera());
 
   // Request a buffer to draw to
   uint32_t swapchainImageIndex;
@@ -384,14 +452,15 @@ void VulkanEngine::present() {
   ImageHelpers::transitionImage(cmd, swapchainEntry.image,
                                 vk::ImageLayout::eUndefined,
                                 vk::ImageLayout::eTransferDstOptimal);
-  Image::copyToSwapchainImage(cmd, *camera.mDrawTarget, swapchainEntry.image,
+  Image::copyToSwapchainImage(cmd, *list.mPresentTarget, swapchainEntry.image,
                               mHandle.mSwapchainExtent);
 
   ImageHelpers::transitionImage(cmd, swapchainEntry.image,
                                 vk::ImageLayout::eTransferDstOptimal,
                                 vk::ImageLayout::eAttachmentOptimal);
   // Draw directly to the swapchain, which matches the format ImGui expects
-  mImgui.draw(mHandle, cmd, swapchainEntry.view);
+  if (auto* drawData = list.mImgui.get())
+    mImgui.draw(mHandle, cmd, swapchainEntry.view, drawData);
   ImageHelpers::transitionImage(cmd, swapchainEntry.image,
                                 vk::ImageLayout::eAttachmentOptimal,
                                 vk::ImageLayout::ePresentSrcKHR);
@@ -408,15 +477,19 @@ void VulkanEngine::present() {
       swapchainEntry.semaphore,
       vk::PipelineStageFlags2::BitsType::eAllGraphics);
   auto submit = VulkanInit::submitInfo(&cmdInfo, &waitInfo, &signalInfo);
-  // Execute
-  check(mHandle.mGraphicsQueue.submit2(1, &submit, frame.mRenderFence));
-
   vk::PresentInfoKHR presentInfo{.waitSemaphoreCount = 1,
                                  .pWaitSemaphores = &swapchainEntry.semaphore,
                                  .swapchainCount = 1,
                                  .pSwapchains = &mHandle.mSwapchain,
                                  .pImageIndices = &swapchainImageIndex};
-  auto result = mHandle.mGraphicsQueue.presentKHR(&presentInfo);
+  vk::Result result;
+  {
+    // Jobs may be submitting uploads at the same time
+    auto lock = mHandle.lockQueue();
+    // Execute
+    check(mHandle.mGraphicsQueue.submit2(1, &submit, frame.mRenderFence));
+    result = mHandle.mGraphicsQueue.presentKHR(&presentInfo);
+  }
   switch (result) {
   case vk::Result::eSuboptimalKHR:
   case vk::Result::eErrorOutOfDateKHR:
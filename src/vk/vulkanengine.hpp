@@ -13,6 +13,7 @@
 #include "imguiwrapper.hpp"
 #include "material.hpp"
 #include "meshloader.hpp"
+#include "renderlist.hpp"
 #include "samplercache.hpp"
 #include "shader.hpp"
 #include "texturemanager.hpp"
@@ -23,11 +24,14 @@
 #include "../core/profiler.hpp"
 #include "../core/singleton.hpp"
 #include "../ecs/registry.hpp"
+#include "../threadpool.hpp"
 
 #include "../../assets/shaders/gradient.h"
 #include "../../assets/shaders/triangle.h"
 
 namespace selwonk::vulkan {
+class RenderSystem;
+
 class VulkanEngine : public core::Singleton<VulkanEngine> {
 public:
   struct FrameData {
@@ -55,6 +59,7 @@ public:
 
   VulkanHandle& getVulkan() { return mHandle; }
   Vfs& getVfs() { return *mVfs; }
+  ThreadPool& getThreadPool() { return mThreadPool; }
 
   TextureManager::Handle getErrorTexture() {
     return mTextureManager.getMissing();
@@ -113,13 +118,16 @@ public:
 
   void writeBackgroundDescriptors();
 
-  void present();
+  // Copy the list's target to the swapchain and submit the frame. Called on
+  // the render thread
+  void present(RenderList& list);
 
   // Sub systems
   const core::Cli& mCli;
   core::Settings& mSettings;
   core::Window& mWindow;
   VulkanHandle& mHandle;
+  ThreadPool mThreadPool;
   ecs::Registry mEcs;
   std::unique_ptr<Vfs> mVfs;
   // TODO: These are not caches, correct the names
@@ -158,8 +166,10 @@ public:
 
   std::unique_ptr<GltfMesh> mMesh;
 
+  // Frames presented, only used by the render thread
   unsigned int mFrameNumber = 0;
 
   CameraSystem* mCamera;
+  RenderSystem* mRenderer;
 };
 } // namespace selwonk::vulkan
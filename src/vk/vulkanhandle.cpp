@@ -73,9 +73,7 @@ VulkanHandle::VulkanHandle(core::Settings& settings, core::Window& window)
 
   auto poolInfo = VulkanInit::commandPoolCreateInfo(mGraphicsQueueFamily);
   check(mDevice.createCommandPool(&poolInfo, nullptr, &mImmediateCommandPool));
-  auto allocInfo = VulkanInit::bufferAllocateInfo(mImmediateCommandPool);
-  check(mDevice.allocateCommandBuffers(&allocInfo, &mImmediateCommandBuffer));
-  mImmediateFence = createFence(/*signalled=*/false);
+  mFenceThread = std::thread(&VulkanHandle::fenceThreadFunc, this);
 
   logLimits();
 };
@@ -151,7 +149,11 @@ void VulkanHandle::initVulkan(bool requestValidationLayers,
 };
 
 void VulkanHandle::resizeSwapchain(glm::uvec2 newSize) {
-  check(mDevice.waitIdle());
+  {
+    // Waiting for the device requires all queues to be synchronised
+    auto lock = lockQueue();
+    check(mDevice.waitIdle());
+  }
   destroySwapchain();
   initSwapchain(newSize);
 }
@@ -211,10 +213,19 @@ void VulkanHandle::logLimits() {
 }
 
 VulkanHandle::~VulkanHandle() {
+  {
+    std::lock_guard lock(mFenceMtx);
+    mFenceQuitting = true;
+  }
+  mFenceCv.notify_one();
+  mFenceThread.join();
+
   destroySwapchain();
 
+  for (auto& submit : mSubmitContexts) {
+    destroyFence(submit->mFence);
+  }
   mDevice.destroyCommandPool(mImmediateCommandPool, nullptr);
-  mDevice.destroyFence(mImmediateFence, nullptr);
 
   vkDestroySurfaceKHR(mInstance, mSurface, nullptr);
   vmaDestroyAllocator(mAllocator);
@@ -249,23 +260,124 @@ void VulkanHandle::destroyFence(vk::Fence fence) {
   mDevice.destroyFence(fence, nullptr);
 }
 
+VulkanHandle::SubmitContext*
+VulkanHandle::submit(std::function<void(vk::CommandBuffer cmd)>& func) {
+  SubmitContext* submit;
+  {
+    std::lock_guard lock(mSubmitMtx);
+    submit = mFreeSubmits;
+    if (submit != nullptr) {
+      mFreeSubmits = submit->mNextFree;
+      check(mDevice.resetFences(1, &submit->mFence));
+      check(submit->mCommandBuffer.reset({}));
+    } else {
+      auto& created =
+          mSubmitContexts.emplace_back(std::make_unique<SubmitContext>());
+      auto allocInfo = VulkanInit::bufferAllocateInfo(mImmediateCommandPool);
+      check(mDevice.allocateCommandBuffers(&allocInfo,
+                                           &created->mCommandBuffer));
+      created->mFence = createFence(/*signalled=*/false);
+      submit = created.get();
+    }
+
+    auto beginInfo = VulkanInit::commandBufferBeginInfo(
+        vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+    check(submit->mCommandBuffer.begin(&beginInfo));
+    func(submit->mCommandBuffer);
+    check(submit->mCommandBuffer.end());
+  }
+
+  auto cmdInfo = VulkanInit::commandBufferSubmitInfo(submit->mCommandBuffer);
+  auto submitInfo = VulkanInit::submitInfo(&cmdInfo, nullptr, nullptr);
+  auto lock = lockQueue();
+  check(mGraphicsQueue.submit2(1, &submitInfo, submit->mFence));
+  return submit;
+}
+
+void VulkanHandle::releaseSubmit(SubmitContext* submit) {
+  std::lock_guard lock(mSubmitMtx);
+  submit->mNextFree = mFreeSubmits;
+  mFreeSubmits = submit;
+}
+
 void VulkanHandle::immediateSubmit(
     std::function<void(vk::CommandBuffer cmd)> func) {
-  check(mDevice.resetFences(1, &mImmediateFence));
-  check(mImmediateCommandBuffer.reset({}));
+  auto* context = submit(func);
+  auto timeout = chronoToVulkan(std::chrono::seconds(1));
+  check(mDevice.waitForFences(1, &context->mFence, /*waitAll=*/true, timeout));
+  releaseSubmit(context);
+}
 
-  auto beginInfo = VulkanInit::commandBufferBeginInfo(
-      vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-  check(mImmediateCommandBuffer.begin(&beginInfo));
-  func(mImmediateCommandBuffer);
-  check(mImmediateCommandBuffer.end());
+VulkanHandle::Submission
+VulkanHandle::submitAsync(std::function<void(vk::CommandBuffer cmd)> func) {
+  return Submission(*this, submit(func));
+}
 
-  auto cmdInfo = VulkanInit::commandBufferSubmitInfo(mImmediateCommandBuffer);
-  auto submitInfo = VulkanInit::submitInfo(&cmdInfo, nullptr, nullptr);
-  check(mGraphicsQueue.submit2(1, &submitInfo, mImmediateFence));
+bool VulkanHandle::Submission::await_ready() {
+  if (mVulkan.mDevice.getFenceStatus(mSubmit->mFence) != vk::Result::eSuccess)
+    return false;
+  mVulkan.releaseSubmit(mSubmit);
+  return true;
+}
 
-  auto timeout = chronoToVulkan(std::chrono::seconds(1));
-  check(mDevice.waitForFences(1, &mImmediateFence, /*waitAll=*/true, timeout));
+void VulkanHandle::Submission::await_suspend(std::coroutine_handle<> handle) {
+  mHandle = handle;
+  mContext = ResumeContext::capture();
+
+  // We may be resumed and destroyed as soon as we're queued, don't touch any
+  // members afterwards
+  VulkanHandle& vulkan = mVulkan;
+  {
+    std::lock_guard lock(vulkan.mFenceMtx);
+    vulkan.mPendingSubmissions.push_back(this);
+  }
+  vulkan.mFenceCv.notify_one();
+}
+
+void VulkanHandle::fenceThreadFunc() {
+  std::vector<Submission*> waiting;
+  std::vector<vk::Fence> fences;
+  while (true) {
+    {
+      std::unique_lock lock(mFenceMtx);
+      if (waiting.empty()) {
+        mFenceCv.wait(lock, [this] {
+          return !mPendingSubmissions.empty() || mFenceQuitting;
+        });
+      }
+      // Let outstanding submissions complete before quitting, as coroutines
+      // are waiting on them
+      if (waiting.empty() && mPendingSubmissions.empty())
+        return;
+
+      waiting.insert(waiting.end(), mPendingSubmissions.begin(),
+                     mPendingSubmissions.end());
+      mPendingSubmissions.clear();
+    }
+
+    // Wait for any of them, waking periodically to pick up new submissions
+    fences.clear();
+    for (auto* submission : waiting) {
+      fences.push_back(submission->mSubmit->mFence);
+    }
+    auto result =
+        mDevice.waitForFences(fences.size(), fences.data(), /*waitAll=*/false,
+                              chronoToVulkan(FencePollInterval));
+    if (result == vk::Result::eTimeout)
+      continue;
+    check(result);
+
+    std::erase_if(waiting, [this](Submission* submission) {
+      auto* submit = submission->mSubmit;
+      if (mDevice.getFenceStatus(submit->mFence) != vk::Result::eSuccess)
+        return false;
+      releaseSubmit(submit);
+      // The submission lives in the coroutine's frame, and may be gone as
+      // soon as it resumes
+      submission->mContext.resume(submission->mHandle);
+      return true;
+    });
+  }
 }
 
 } // namespace selwonk::vulkan
@@ -1,12 +1,18 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
 #include <functional>
+#include <mutex>
 #include <set>
+#include <thread>
 #include <vector>
 
 #include "../core/settings.hpp"
 #include "../core/singleton.hpp"
 #include "../core/window.hpp"
+#include "../task.hpp"
 #include "image.hpp"
 #include "vulkan/vulkan.hpp"
 #include <glm/ext/vector_int2.hpp>
@@ -17,6 +23,13 @@
 
 namespace selwonk::vulkan {
 class VulkanHandle : public core::Singleton<VulkanHandle> {
+  // Command buffer and fence for a single immediate submission
+  struct SubmitContext {
+    vk::CommandBuffer mCommandBuffer;
+    vk::Fence mFence;
+    SubmitContext* mNextFree = nullptr;
+  };
+
 public:
   const static constexpr uint32_t MinVulkanMajor = 1;
   const static constexpr uint32_t MinVulkanMinor = 3;
@@ -31,9 +44,42 @@ public:
   void destroyFence(vk::Fence fence);
 
   // Submit and execute a command buffer immediately, blocks until completion
-  // Prefer async submission if at all possible
+  // Prefer submitAsync if at all possible
+  // Thread-safe, unlike the rest of the handle
   void immediateSubmit(std::function<void(vk::CommandBuffer cmd)> func);
 
+  // Commands submitted to the GPU, to be co_awaited. See submitAsync
+  class [[nodiscard]] Submission {
+  public:
+    // Don't suspend if the GPU has already finished
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() {}
+
+  private:
+    friend class VulkanHandle;
+    Submission(VulkanHandle& vulkan, SubmitContext* submit)
+        : mVulkan(vulkan), mSubmit(submit) {}
+
+    VulkanHandle& mVulkan;
+    SubmitContext* mSubmit;
+    ResumeContext mContext;
+    std::coroutine_handle<> mHandle;
+  };
+
+  // Submit a command buffer without waiting for it to complete. co_await the
+  // result to suspend the calling coroutine until the GPU has finished,
+  // without blocking a thread. The result must be awaited, as it holds on to
+  // the command buffer until then
+  // Thread-safe, unlike the rest of the handle
+  Submission submitAsync(std::function<void(vk::CommandBuffer cmd)> func);
+
+  // The graphics queue must be externally synchronised, and may be submitted
+  // to from jobs. Hold this while using it directly
+  std::unique_lock<std::mutex> lockQueue() {
+    return std::unique_lock(mQueueMtx);
+  }
+
   // TODO: Make private
   const core::Settings& mSettings;
 
@@ -83,6 +129,13 @@ private:
   void logLimits();
 
   void initVulkan(bool requestValidationLayers, core::Window& window);
+
+  // Record and submit commands using a free context. Thread-safe
+  SubmitContext* submit(std::function<void(vk::CommandBuffer cmd)>& func);
+  void releaseSubmit(SubmitContext* submit);
+  // Entry point for the fence thread. Resume coroutines as their submissions
+  // complete, until exit
+  void fenceThreadFunc();
   void destroySwapchain();
   void initSwapchain(glm::uvec2 windowSize);
 
@@ -93,8 +146,24 @@ private:
       "VUID-VkDeviceCreateInfo-pNext-02830",
   };
 
-  vk::Fence mImmediateFence;
-  vk::CommandBuffer mImmediateCommandBuffer;
+  // How often the fence thread checks for new submissions while waiting on
+  // others
+  const static constexpr std::chrono::milliseconds FencePollInterval{1};
+
+  std::mutex mQueueMtx;
+
+  // Guards the command pool and free contexts. Command buffers are recorded
+  // while holding this, as the pool must be externally synchronised
+  std::mutex mSubmitMtx;
   vk::CommandPool mImmediateCommandPool;
+  std::vector<std::unique_ptr<SubmitContext>> mSubmitContexts;
+  SubmitContext* mFreeSubmits = nullptr;
+
+  // Submissions being awaited, handed over to the fence thread
+  std::mutex mFenceMtx;
+  std::condition_variable mFenceCv;
+  std::vector<Submission*> mPendingSubmissions;
+  bool mFenceQuitting = false;
+  std::thread mFenceThread;
 };
 } // namespace selwonk::vulkan